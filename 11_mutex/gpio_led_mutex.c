@@ -24,6 +24,8 @@
 #include <linux/of_gpio.h>
 #include <linux/mutex.h>
 
+#include "drv_debug.h"
+
 
 #define NAME "gpio_led_mutex"
 #define CHAR_DEV_BASE_MAJOR 100
@@ -65,13 +67,13 @@ void led_off(void)
 /* The various file operations we support. */
 int led_open (struct inode *inode, struct file *filp)
 {
-    printk(NAME " open\n");
+    DRV_DBG(NAME " open\n");
     filp->private_data = &led;
 
 
     // mutex - can be interrupted by signals
     if(mutex_lock_interruptible(&led.mutex)) {
-        printk(NAME " mutex interrupted by signal\n");
+        DRV_DBG(NAME " mutex interrupted by signal\n");
         return -ERESTARTSYS;
     }
 
@@ -80,7 +82,7 @@ int led_open (struct inode *inode, struct file *filp)
 
 int led_release (struct inode *inode, struct file *filp)
 {
-    printk(NAME " release\n");
+    DRV_DBG(NAME " release\n");
     filp->private_data = NULL;
 
     // mutex
@@ -97,17 +99,17 @@ ssize_t led_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
     int copy_len = 0;
     int gpio_val;
     
-    printk(NAME " read\n");
+    DRV_DBG(NAME " read\n");
 
     // read led status - use internal state instead of gpio_get_value for output pins
     gpio_val = gpio_get_value(led.led_gpio);
-    printk(NAME " gpio_get_value: %d, led_state: %d\n", gpio_val, led.led_state);
+    DRV_DBG(NAME " gpio_get_value: %d, led_state: %d\n", gpio_val, led.led_state);
     
     if(led.led_state == 1){
-        printk(NAME " led is ON\n");
+        DRV_DBG(NAME " led is ON\n");
         snprintf(read_buf, sizeof(read_buf), "LED is ON\n");
     } else {
-        printk(NAME " led is OFF\n");
+        DRV_DBG(NAME " led is OFF\n");
         snprintf(read_buf, sizeof(read_buf), "LED is OFF\n");
     }
 
@@ -116,37 +118,37 @@ ssize_t led_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
 
     ret = copy_to_user(buf, read_buf, copy_len); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_to_user failed, %d bytes not copied\n", ret);
+        DRV_DBG(NAME " copy_to_user failed, %d bytes not copied\n", ret);
         return -EFAULT;
     }
     
-    printk(NAME " read %d bytes successfully\n", copy_len);
+    DRV_DBG(NAME " read %d bytes successfully\n", copy_len);
     return copy_len;  // 返回实际读取的字节数
 }
 ssize_t led_write (struct file *filp, const char __user *buf, size_t count, loff_t *ppos)
 {
     int ret = 0;
-    printk(NAME " write %d\n", count);
+    DRV_DBG(NAME " write %d\n", count);
 
     if(count >= sizeof(write_buf)) count = sizeof(write_buf) - 1;
     
     ret = copy_from_user(write_buf, buf, count); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_from_user failed %d\n", ret);
+        DRV_DBG(NAME " copy_from_user failed %d\n", ret);
         return -EFAULT;
     }
 
     write_buf[count] = '\0'; // null terminate the string
-    printk(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
+    DRV_DBG(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
 
     if(strncmp(write_buf, "on", 2) == 0) {
         led_on();
-        printk(NAME " led on\n");
+        DRV_DBG(NAME " led on\n");
     } else if(strncmp(write_buf, "off", 3) == 0) {
         led_off();
-        printk(NAME " led off\n");
+        DRV_DBG(NAME " led off\n");
     } else {
-        printk(NAME " invalid command\n");
+        DRV_DBG(NAME " invalid command\n");
     }
 
     return count;
@@ -24,6 +24,8 @@
 #include <linux/of_gpio.h>
 #include <linux/atomic.h> // atomic_t
 
+#include "drv_debug.h"
+
 
 #define NAME "key"
 #define CHAR_DEV_BASE_MAJOR 100
@@ -52,7 +54,7 @@ char write_buf[100];
 /* The various file operations we support. */
 int key_open (struct inode *inode, struct file *filp)
 {
-    printk(NAME " open\n");
+    DRV_DBG(NAME " open\n");
     filp->private_data = &key;
 
     return 0;
@@ -60,7 +62,7 @@ int key_open (struct inode *inode, struct file *filp)
 
 int key_release (struct inode *inode, struct file *filp)
 {
-    printk(NAME " release\n");
+    DRV_DBG(NAME " release\n");
     filp->private_data = NULL;
 
     return 0;
@@ -92,7 +94,7 @@ ssize_t key_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
 
     ret = copy_to_user(buf, &gpio_val, copy_len); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_to_user failed, %d bytes not copied\n", ret);
+        DRV_DBG(NAME " copy_to_user failed, %d bytes not copied\n", ret);
         return -EFAULT;
     }
     
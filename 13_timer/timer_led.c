@@ -24,6 +24,12 @@
 #include <linux/of_gpio.h>
 #include <linux/timer.h>
 #include <linux/jiffies.h>
+#include <linux/ioctl.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/leds.h>
+
+#include "drv_debug.h"
 
 
 #define NAME "timer_led"
@@ -34,6 +40,18 @@
 
 #define LED_TOGGLE_INTERVAL_MS 500
 
+#define LED_PWM_LEVELS          255     // brightness 0..255
+#define LED_PWM_FREQ_DEFAULT    200     // Hz
+#define LED_PWM_FREQ_MIN        50
+#define LED_PWM_FREQ_MAX        2000
+#define LED_PWM_MIN_EDGE_NS     20000   // shortest on/off phase the timer is asked for
+
+// same numbers as 14_ioctl
+#define LED_IOCTL_MAGIC 'x'
+#define LED_SET_BRIGHTNESS  _IOW(LED_IOCTL_MAGIC, 5, int)
+#define LED_GET_BRIGHTNESS  _IOR(LED_IOCTL_MAGIC, 6, int)
+#define LED_SET_PWM_FREQ    _IOW(LED_IOCTL_MAGIC, 7, int)
+#define LED_GET_PWM_FREQ    _IOR(LED_IOCTL_MAGIC, 8, int)
 
 struct led_dev{
     dev_t devid;    // device id
@@ -46,6 +64,18 @@ struct led_dev{
     int led_state; // led state: 1=on, 0=off
 
     struct timer_list timer;
+
+    // software pwm
+    struct hrtimer pwm_timer;
+    spinlock_t pwm_lock;    // led_state, brightness and pwm_* vs. pwm timer
+    int brightness;         // 0..LED_PWM_LEVELS, level while the LED is on
+    int pwm_freq;           // Hz
+    u64 pwm_on_ns;          // phase lengths, precomputed on every change
+    u64 pwm_off_ns;
+    int pwm_level;          // output within the current period
+    int pwm_running;        // pwm timer armed
+
+    struct led_classdev led_cdev;   // /sys/class/leds/NAME
 };
 
 struct led_dev led;
@@ -54,29 +84,167 @@ char read_buf[100];
 char write_buf[100];
 
 
-void led_on(void)
+void led_on(struct led_dev *led);
+void led_off(struct led_dev *led);
+
+static void led_gpio_set(struct led_dev *led, int on)
 {
-    gpio_set_value(led.led_gpio, 0);
-    led.led_state = 1;
+    gpio_set_value(led->led_gpio, on ? 0 : 1);  // active low
+}
+
+// precompute the on/off phase lengths, caller holds pwm_lock
+static void led_pwm_update(struct led_dev *led)
+{
+    u64 period = NSEC_PER_SEC / led->pwm_freq;
+    u64 on = div_u64(period * led->brightness + LED_PWM_LEVELS / 2, LED_PWM_LEVELS);
+
+    // phases too short for a timer edge snap to fully off / fully on
+    if(on < LED_PWM_MIN_EDGE_NS)
+    {
+        on = 0;
+    }
+    else if(period - on < LED_PWM_MIN_EDGE_NS)
+    {
+        on = period;
+    }
+
+    led->pwm_on_ns = on;
+    led->pwm_off_ns = period - on;
 }
 
-void led_off(void)
+// the pwm timer only runs for a lit LED at a partial duty
+static int led_pwm_needed(struct led_dev *led)
 {
-    gpio_set_value(led.led_gpio, 1);
-    led.led_state = 0;
+    return led->led_state && led->pwm_on_ns && led->pwm_off_ns;
+}
+
+// drive the LED for led_state and brightness, caller holds pwm_lock
+static void led_pwm_apply(struct led_dev *led)
+{
+    if(!led_pwm_needed(led))
+    {
+        // steady level; a running pwm timer sees this and stops itself
+        led_gpio_set(led, led->led_state && led->pwm_on_ns);
+        return;
+    }
+
+    // a running timer picks up new phase lengths at its next edge
+    if(!led->pwm_running)
+    {
+        led->pwm_running = 1;
+        led->pwm_level = 1;
+        led_gpio_set(led, 1);
+        hrtimer_start(&led->pwm_timer, ns_to_ktime(led->pwm_on_ns), HRTIMER_MODE_REL);
+    }
+}
+
+// pwm timer function - one expiry per edge
+static enum hrtimer_restart led_pwm_timer_func(struct hrtimer *timer)
+{
+    struct led_dev *led = container_of(timer, struct led_dev, pwm_timer);
+    u64 next;
+
+    spin_lock(&led->pwm_lock);
+    if(!led_pwm_needed(led))
+    {
+        led->pwm_running = 0;
+        spin_unlock(&led->pwm_lock);
+        return HRTIMER_NORESTART;
+    }
+
+    led->pwm_level = !led->pwm_level;
+    led_gpio_set(led, led->pwm_level);
+    next = led->pwm_level ? led->pwm_on_ns : led->pwm_off_ns;
+    spin_unlock(&led->pwm_lock);
+
+    // step from this edge's deadline, so the period does not drift
+    hrtimer_set_expires(timer, ktime_add_ns(hrtimer_get_expires(timer), next));
+
+    // fell behind (irqs were off): skip the missed edges instead of bursting through them
+    if(ktime_before(hrtimer_get_expires(timer), hrtimer_cb_get_time(timer)))
+    {
+        hrtimer_forward_now(timer, ns_to_ktime(next));
+    }
+
+    return HRTIMER_RESTART;
+}
+
+void led_set_brightness(struct led_dev *led, int brightness)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&led->pwm_lock, flags);
+    led->brightness = brightness;
+    led_pwm_update(led);
+    led_pwm_apply(led);
+    spin_unlock_irqrestore(&led->pwm_lock, flags);
+}
+
+void led_set_pwm_freq(struct led_dev *led, int freq)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&led->pwm_lock, flags);
+    led->pwm_freq = freq;
+    led_pwm_update(led);
+    led_pwm_apply(led);
+    spin_unlock_irqrestore(&led->pwm_lock, flags);
+}
+
+// LED class: 0 turns the LED off, anything else lights it at that level
+static void led_cdev_brightness_set(struct led_classdev *led_cdev, enum led_brightness value)
+{
+    struct led_dev *led = container_of(led_cdev, struct led_dev, led_cdev);
+
+    if(value == LED_OFF)
+    {
+        led_off(led);
+    }
+    else
+    {
+        led_set_brightness(led, value);
+        led_on(led);
+    }
+}
+
+static enum led_brightness led_cdev_brightness_get(struct led_classdev *led_cdev)
+{
+    struct led_dev *led = container_of(led_cdev, struct led_dev, led_cdev);
+
+    return led->led_state ? led->brightness : LED_OFF;
+}
+
+void led_on(struct led_dev *led)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&led->pwm_lock, flags);
+    led->led_state = 1;
+    led_pwm_apply(led);
+    spin_unlock_irqrestore(&led->pwm_lock, flags);
+}
+
+void led_off(struct led_dev *led)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&led->pwm_lock, flags);
+    led->led_state = 0;
+    led_pwm_apply(led);
+    spin_unlock_irqrestore(&led->pwm_lock, flags);
 }
 
 /* The various file operations we support. */
 int led_open (struct inode *inode, struct file *filp)
 {
-    printk(NAME " open\n");
+    DRV_DBG(NAME " open\n");
     filp->private_data = &led;
     return 0;
 }
 
 int led_release (struct inode *inode, struct file *filp)
 {
-    printk(NAME " release\n");
+    DRV_DBG(NAME " release\n");
     filp->private_data = NULL;
     return 0;
 }
@@ -88,17 +256,17 @@ ssize_t led_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
     int copy_len = 0;
     int gpio_val;
     
-    printk(NAME " read\n");
+    DRV_DBG(NAME " read\n");
 
     // read led status - use internal state instead of gpio_get_value for output pins
     gpio_val = gpio_get_value(led.led_gpio);
-    printk(NAME " gpio_get_value: %d, led_state: %d\n", gpio_val, led.led_state);
+    DRV_DBG(NAME " gpio_get_value: %d, led_state: %d\n", gpio_val, led.led_state);
     
     if(led.led_state == 1){
-        printk(NAME " led is ON\n");
+        DRV_DBG(NAME " led is ON\n");
         snprintf(read_buf, sizeof(read_buf), "LED is ON\n");
     } else {
-        printk(NAME " led is OFF\n");
+        DRV_DBG(NAME " led is OFF\n");
         snprintf(read_buf, sizeof(read_buf), "LED is OFF\n");
     }
 
@@ -107,49 +275,83 @@ ssize_t led_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
 
     ret = copy_to_user(buf, read_buf, copy_len); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_to_user failed, %d bytes not copied\n", ret);
+        DRV_DBG(NAME " copy_to_user failed, %d bytes not copied\n", ret);
         return -EFAULT;
     }
     
-    printk(NAME " read %d bytes successfully\n", copy_len);
+    DRV_DBG(NAME " read %d bytes successfully\n", copy_len);
     return copy_len;  // 返回实际读取的字节数
 }
 ssize_t led_write (struct file *filp, const char __user *buf, size_t count, loff_t *ppos)
 {
     int ret = 0;
-    printk(NAME " write %d\n", count);
+    DRV_DBG(NAME " write %d\n", count);
 
     if(count >= sizeof(write_buf)) count = sizeof(write_buf) - 1;
     
     ret = copy_from_user(write_buf, buf, count); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_from_user failed %d\n", ret);
+        DRV_DBG(NAME " copy_from_user failed %d\n", ret);
         return -EFAULT;
     }
 
     write_buf[count] = '\0'; // null terminate the string
-    printk(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
+    DRV_DBG(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
 
     if(strncmp(write_buf, "on", 2) == 0) {
-        led_on();
-        printk(NAME " led on\n");
+        led_on(&led);
+        DRV_DBG(NAME " led on\n");
     } else if(strncmp(write_buf, "off", 3) == 0) {
-        led_off();
-        printk(NAME " led off\n");
+        led_off(&led);
+        DRV_DBG(NAME " led off\n");
     } else {
-        printk(NAME " invalid command\n");
+        DRV_DBG(NAME " invalid command\n");
     }
 
     return count;
 }
 
+// led ioctl - brightness and pwm frequency
+long led_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct led_dev *led = (struct led_dev *)filp->private_data;
+    if(!led) return -EINVAL;
+
+    switch(cmd) {
+        case LED_SET_BRIGHTNESS:
+            if((int)arg < 0 || (int)arg > LED_PWM_LEVELS) {
+                DRV_DBG(NAME " invalid brightness: %d\n", (int)arg);
+                return -EINVAL;
+            }
+            led_set_brightness(led, (int)arg);
+            break;
+        case LED_GET_BRIGHTNESS:
+            return led->brightness;
+        case LED_SET_PWM_FREQ:
+            if((int)arg < LED_PWM_FREQ_MIN || (int)arg > LED_PWM_FREQ_MAX) {
+                DRV_DBG(NAME " invalid pwm frequency: %d\n", (int)arg);
+                return -EINVAL;
+            }
+            led_set_pwm_freq(led, (int)arg);
+            break;
+        case LED_GET_PWM_FREQ:
+            return led->pwm_freq;
+        default:
+            DRV_DBG(NAME " invalid ioctl cmd\n");
+            return -EINVAL;
+    }
+
+    return 0;
+}
+
 
 static const struct file_operations led_fops = {
 	.owner		= THIS_MODULE,
     .open      = led_open,
     .release   = led_release,
     .read      = led_read,
-    .write     = led_write
+    .write     = led_write,
+    .unlocked_ioctl = led_ioctl,
 };
 
 
@@ -159,11 +361,9 @@ static void led_timer_func(unsigned long data)
     struct led_dev *led = (struct led_dev *)data;
     // printk(NAME " led_timer_func\n");
     if(led->led_state == 1) {
-        led->led_state = 0;
-        led_off();
+        led_off(led);
     } else {
-        led->led_state = 1;
-        led_on();
+        led_on(led);
     }
 
     // update timer
@@ -247,8 +447,16 @@ static int __init led_init(void)
     // set gpio value
     gpio_set_value(led.led_gpio, 0);
 
+    // init software pwm, full brightness until told otherwise
+    spin_lock_init(&led.pwm_lock);
+    hrtimer_init(&led.pwm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    led.pwm_timer.function = led_pwm_timer_func;
+    led.brightness = LED_PWM_LEVELS;
+    led.pwm_freq = LED_PWM_FREQ_DEFAULT;
+    led.pwm_running = 0;
+    led_pwm_update(&led);
 
-    led_off();
+    led_off(&led);
 
     // init timer
     init_timer(&led.timer);
@@ -265,7 +473,7 @@ static int __init led_init(void)
         rc = register_chrdev_region(led.devid, LED_COUNT, NAME);
         if(rc < 0) {
             printk(NAME " register_chrdev_region failed\n");
-            goto err_gpio_request;
+            goto err_timer;
         }
     }
     else
@@ -273,7 +481,7 @@ static int __init led_init(void)
         rc = alloc_chrdev_region(&led.devid, 0, LED_COUNT, NAME);
         if(rc < 0) {
             printk(NAME " alloc_chrdev_region failed\n");
-            goto err_gpio_request;
+            goto err_timer;
         }
 
         led.major = MAJOR(led.devid);
@@ -304,14 +512,31 @@ static int __init led_init(void)
         goto err_class;
     }
 
+    // led class device
+    led.led_cdev.name = NAME;
+    led.led_cdev.max_brightness = LED_PWM_LEVELS;
+    led.led_cdev.brightness_set = led_cdev_brightness_set;
+    led.led_cdev.brightness_get = led_cdev_brightness_get;
+    rc = led_classdev_register(led.led_device, &led.led_cdev);
+    if(rc) {
+        printk(NAME " led_classdev_register failed\n");
+        goto err_device;
+    }
+
 	return 0;
 
+err_device:
+    device_destroy(led.led_class, led.devid);
 err_class:
     class_destroy(led.led_class);
 err_cdev:
     cdev_del(&led.cdev);
 err_chrdev:
     unregister_chrdev_region(led.devid, LED_COUNT);
+err_timer:
+    del_timer_sync(&led.timer);
+    led_off(&led);
+    hrtimer_cancel(&led.pwm_timer);
 err_gpio_request:
     gpio_free(led.led_gpio);
 
@@ -324,7 +549,12 @@ static void __exit led_exit(void)
 	// printk(KERN_DEBUG NAME " exit\n");
 	printk(NAME " exit\n");
 
-    led_off();
+    led_classdev_unregister(&led.led_cdev);
+
+    // stop the blink timer first, it would turn the LED back on
+    del_timer_sync(&led.timer);
+    led_off(&led);
+    hrtimer_cancel(&led.pwm_timer);
 
     // cleanup in reverse order of initialization
     device_destroy(led.led_class, led.devid);
@@ -334,9 +564,6 @@ static void __exit led_exit(void)
 
     // gpio free
     gpio_free(led.led_gpio);
-
-    // deletee timer
-    del_timer_sync(&led.timer);
 }
 
 module_init(led_init);
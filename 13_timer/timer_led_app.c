@@ -3,6 +3,13 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+
+#define LED_IOCTL_MAGIC 'x'
+#define LED_SET_BRIGHTNESS  _IOW(LED_IOCTL_MAGIC, 5, int)
+#define LED_GET_BRIGHTNESS  _IOR(LED_IOCTL_MAGIC, 6, int)
+#define LED_SET_PWM_FREQ    _IOW(LED_IOCTL_MAGIC, 7, int)
+#define LED_GET_PWM_FREQ    _IOR(LED_IOCTL_MAGIC, 8, int)
 
 /*
 *
@@ -20,7 +27,7 @@ int main(int argc, char *argv[])
     int cmd;
 
     if(argc < 3) {
-        printf("Usage: %s <device_file> <1-read,2-write> <string to write>\n", argv[0]);
+        printf("Usage: %s <device_file> <1-read,2-write,3-brightness,4-pwm freq> <string to write | value>\n", argv[0]);
         return -1;
     }
     filename = argv[1];
@@ -73,6 +80,30 @@ int main(int argc, char *argv[])
             printf("Wrote %d to device\n", ret);
         }
     }
+    else if(cmd == 3 || cmd == 4) // brightness 0-255 / pwm frequency in Hz
+    {
+        int ret = 0;
+        const char *what = cmd == 3 ? "brightness" : "pwm frequency";
+
+        if(argc >= 4)
+        {
+            ret = ioctl(fd, cmd == 3 ? LED_SET_BRIGHTNESS : LED_SET_PWM_FREQ, atoi(argv[3]));
+            if(ret < 0)
+            {
+                printf("Failed to set %s\n", what);
+            }
+        }
+
+        ret = ioctl(fd, cmd == 3 ? LED_GET_BRIGHTNESS : LED_GET_PWM_FREQ);
+        if(ret < 0)
+        {
+            printf("Failed to get %s\n", what);
+        }
+        else
+        {
+            printf("LED %s: %d\n", what, ret);
+        }
+    }
     else
     {
         printf("Invalid command\n");
@@ -22,9 +22,16 @@
 #include <linux/slab.h> // kmalloc, kfree
 #include <linux/gpio.h>
 #include <linux/of_gpio.h>
+#include <linux/gpio/consumer.h> // gpiod_set_raw_array_value
 #include <linux/timer.h>
 #include <linux/jiffies.h>
 #include <linux/ioctl.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/leds.h>     // before LED_OFF below, which shadows enum led_brightness
+#include <linux/mutex.h>
+
+#include "drv_debug.h"
 
 
 #define NAME "timer_led_ioctl"
@@ -35,12 +42,49 @@
 
 #define LED_TOGGLE_INTERVAL_MS 500
 
+#define LED_MAX_NUM     16      // led-gpios entries, one bit each in the LED_SET_LEDS mask
+
+#define LED_PWM_LEVELS          255     // brightness 0..255
+#define LED_PWM_FREQ_DEFAULT    200     // Hz
+#define LED_PWM_FREQ_MIN        50
+#define LED_PWM_FREQ_MAX        2000
+#define LED_PWM_MIN_EDGE_NS     20000   // shortest on/off phase the timer is asked for
+
 #define LED_IOCTL_MAGIC 'x'
 #define LED_ON          _IO(LED_IOCTL_MAGIC, 0)
 #define LED_OFF         _IO(LED_IOCTL_MAGIC, 1)
 #define LED_GET_STATE   _IOR(LED_IOCTL_MAGIC, 2, int)
 #define LED_SET_PERIOD  _IOW(LED_IOCTL_MAGIC, 3, int)
 #define LED_GET_PERIOD  _IOR(LED_IOCTL_MAGIC, 4, int)
+#define LED_SET_BRIGHTNESS  _IOW(LED_IOCTL_MAGIC, 5, int)
+#define LED_GET_BRIGHTNESS  _IOR(LED_IOCTL_MAGIC, 6, int)
+#define LED_SET_PWM_FREQ    _IOW(LED_IOCTL_MAGIC, 7, int)
+#define LED_GET_PWM_FREQ    _IOR(LED_IOCTL_MAGIC, 8, int)
+
+#define LED_PATTERN_MAX_STEPS   32
+#define LED_PATTERN_MIN_STEP_US 100
+#define LED_PATTERN_MAX_STEP_US 60000000    // one minute per step
+
+// one step of a blink code: hold brightness level (0 = off) for duration_us
+struct led_pattern_step {
+    __u16 level;
+    __u16 reserved;
+    __u32 duration_us;
+};
+
+// count == 0 stops a running pattern; repeat == 0 loops until replaced
+struct led_pattern {
+    __u32 count;
+    __u32 repeat;
+    struct led_pattern_step steps[LED_PATTERN_MAX_STEPS];
+};
+
+#define LED_SET_PATTERN     _IOW(LED_IOCTL_MAGIC, 9, struct led_pattern)
+
+// bit n = led-gpios entry n, all LEDs switched by one gpio array write
+#define LED_SET_LEDS    _IOW(LED_IOCTL_MAGIC, 10, int)
+#define LED_GET_LEDS    _IOR(LED_IOCTL_MAGIC, 11, int)
+#define LED_GET_NUM     _IOR(LED_IOCTL_MAGIC, 12, int)
 
 struct led_dev{
     dev_t devid;    // device id
@@ -49,13 +93,40 @@ struct led_dev{
     struct class *led_class;    // class
     struct device *led_device;  // device
     struct device_node *np;     // device node
-    int led_gpio; // led gpio
+    int led_gpio; // led gpio, led_gpios[0]: blink, pwm and pattern LED
     int led_state; // led state: 1=on, 0=off
 
+    // every led-gpios entry, switched together by LED_SET_LEDS
+    int led_num;
+    int led_gpios[LED_MAX_NUM];
+    struct gpio_desc *led_descs[LED_MAX_NUM];
+    u32 led_mask;           // state of LEDs 1..led_num-1, LED 0 is led_state
+
     int led_period;    // led period
     spinlock_t lock;  // protect led_period
 
     struct timer_list timer;
+
+    // software pwm
+    struct hrtimer pwm_timer;
+    spinlock_t pwm_lock;    // led_state, brightness and pwm_* vs. pwm timer
+    int brightness;         // 0..LED_PWM_LEVELS, level while the LED is on
+    int pwm_freq;           // Hz
+    u64 pwm_on_ns;          // phase lengths, precomputed on every change
+    u64 pwm_off_ns;
+    int pwm_level;          // output within the current period
+    int pwm_running;        // pwm timer armed
+
+    struct led_classdev led_cdev;   // /sys/class/leds/NAME
+
+    // pattern sequencer, state under pwm_lock
+    struct hrtimer pattern_timer;
+    struct mutex pattern_mutex;     // serializes pattern uploads and stops
+    struct led_pattern pattern;
+    int pattern_step;
+    u32 pattern_loops;              // completed passes
+    int pattern_running;
+    int pattern_saved_brightness;   // restored when the pattern ends
 };
 
 struct led_dev led;
@@ -65,30 +136,327 @@ char write_buf[100];
 
 
 static void led_timer_func(unsigned long data);
+void led_on(struct led_dev *led);
+void led_off(struct led_dev *led);
+
+static void led_gpio_set(struct led_dev *led, int on)
+{
+    gpio_set_value(led->led_gpio, on ? 0 : 1);  // active low
+}
+
+// set every LED from mask in one call, the controller can latch them with one register write
+static void led_set_array(struct led_dev *led, u32 mask)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,18,0)
+    DECLARE_BITMAP(values, LED_MAX_NUM);
+
+    values[0] = ~mask & GENMASK(led->led_num - 1, 0);   // active low
+    gpiod_set_raw_array_value(led->led_num, led->led_descs, NULL, values);
+#else
+    int values[LED_MAX_NUM];
+    int i;
+
+    for(i = 0; i < led->led_num; i++)
+    {
+        values[i] = (mask & BIT(i)) ? 0 : 1;    // active low
+    }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
+    gpiod_set_raw_array_value(led->led_num, led->led_descs, values);
+#else
+    gpiod_set_raw_array(led->led_num, led->led_descs, values);
+#endif
+#endif
+}
+
+// precompute the on/off phase lengths, caller holds pwm_lock
+static void led_pwm_update(struct led_dev *led)
+{
+    u64 period = NSEC_PER_SEC / led->pwm_freq;
+    u64 on = div_u64(period * led->brightness + LED_PWM_LEVELS / 2, LED_PWM_LEVELS);
+
+    // phases too short for a timer edge snap to fully off / fully on
+    if(on < LED_PWM_MIN_EDGE_NS)
+    {
+        on = 0;
+    }
+    else if(period - on < LED_PWM_MIN_EDGE_NS)
+    {
+        on = period;
+    }
+
+    led->pwm_on_ns = on;
+    led->pwm_off_ns = period - on;
+}
+
+// the pwm timer only runs for a lit LED at a partial duty
+static int led_pwm_needed(struct led_dev *led)
+{
+    return led->led_state && led->pwm_on_ns && led->pwm_off_ns;
+}
+
+// drive the LED for led_state and brightness, caller holds pwm_lock
+static void led_pwm_apply(struct led_dev *led)
+{
+    if(!led_pwm_needed(led))
+    {
+        // steady level; a running pwm timer sees this and stops itself
+        led_gpio_set(led, led->led_state && led->pwm_on_ns);
+        return;
+    }
+
+    // a running timer picks up new phase lengths at its next edge
+    if(!led->pwm_running)
+    {
+        led->pwm_running = 1;
+        led->pwm_level = 1;
+        led_gpio_set(led, 1);
+        hrtimer_start(&led->pwm_timer, ns_to_ktime(led->pwm_on_ns), HRTIMER_MODE_REL);
+    }
+}
+
+// pwm timer function - one expiry per edge
+static enum hrtimer_restart led_pwm_timer_func(struct hrtimer *timer)
+{
+    struct led_dev *led = container_of(timer, struct led_dev, pwm_timer);
+    u64 next;
+
+    spin_lock(&led->pwm_lock);
+    if(!led_pwm_needed(led))
+    {
+        led->pwm_running = 0;
+        spin_unlock(&led->pwm_lock);
+        return HRTIMER_NORESTART;
+    }
+
+    led->pwm_level = !led->pwm_level;
+    led_gpio_set(led, led->pwm_level);
+    next = led->pwm_level ? led->pwm_on_ns : led->pwm_off_ns;
+    spin_unlock(&led->pwm_lock);
+
+    // step from this edge's deadline, so the period does not drift
+    hrtimer_set_expires(timer, ktime_add_ns(hrtimer_get_expires(timer), next));
+
+    // fell behind (irqs were off): skip the missed edges instead of bursting through them
+    if(ktime_before(hrtimer_get_expires(timer), hrtimer_cb_get_time(timer)))
+    {
+        hrtimer_forward_now(timer, ns_to_ktime(next));
+    }
+
+    return HRTIMER_RESTART;
+}
+
+void led_set_brightness(struct led_dev *led, int brightness)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&led->pwm_lock, flags);
+    led->brightness = brightness;
+    led_pwm_update(led);
+    led_pwm_apply(led);
+    spin_unlock_irqrestore(&led->pwm_lock, flags);
+}
+
+void led_set_pwm_freq(struct led_dev *led, int freq)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&led->pwm_lock, flags);
+    led->pwm_freq = freq;
+    led_pwm_update(led);
+    led_pwm_apply(led);
+    spin_unlock_irqrestore(&led->pwm_lock, flags);
+}
+
+// LED class: 0 turns the LED off, anything else lights it at that level
+static void led_cdev_brightness_set(struct led_classdev *led_cdev, enum led_brightness value)
+{
+    struct led_dev *led = container_of(led_cdev, struct led_dev, led_cdev);
+
+    if(value == 0)
+    {
+        led_off(led);
+    }
+    else
+    {
+        led_set_brightness(led, value);
+        led_on(led);
+    }
+}
+
+static enum led_brightness led_cdev_brightness_get(struct led_classdev *led_cdev)
+{
+    struct led_dev *led = container_of(led_cdev, struct led_dev, led_cdev);
+
+    return led->led_state ? led->brightness : 0;
+}
+
+// show the current pattern step, caller holds pwm_lock
+static void led_pattern_show_step(struct led_dev *led)
+{
+    struct led_pattern_step *step = &led->pattern.steps[led->pattern_step];
+
+    led->brightness = step->level;
+    led->led_state = step->level ? 1 : 0;
+    led_pwm_update(led);
+    led_pwm_apply(led);
+}
+
+// end the pattern with the LED off at the brightness it had before, caller holds pwm_lock
+static void led_pattern_end(struct led_dev *led)
+{
+    led->pattern_running = 0;
+    led->brightness = led->pattern_saved_brightness;
+    led->led_state = 0;
+    led_pwm_update(led);
+    led_pwm_apply(led);
+}
+
+// pattern timer function - one expiry per step, no userspace wakeups
+static enum hrtimer_restart led_pattern_timer_func(struct hrtimer *timer)
+{
+    struct led_dev *led = container_of(timer, struct led_dev, pattern_timer);
+    u32 next_us;
+
+    spin_lock(&led->pwm_lock);
+    if(!led->pattern_running)
+    {
+        spin_unlock(&led->pwm_lock);
+        return HRTIMER_NORESTART;
+    }
+
+    if(++led->pattern_step >= led->pattern.count)
+    {
+        led->pattern_step = 0;
+        led->pattern_loops++;
+        if(led->pattern.repeat && led->pattern_loops >= led->pattern.repeat)
+        {
+            led_pattern_end(led);
+            spin_unlock(&led->pwm_lock);
+            return HRTIMER_NORESTART;
+        }
+    }
+
+    led_pattern_show_step(led);
+    next_us = led->pattern.steps[led->pattern_step].duration_us;
+    spin_unlock(&led->pwm_lock);
+
+    // step from this step's deadline, the pattern keeps its rhythm
+    hrtimer_set_expires(timer, ktime_add_us(hrtimer_get_expires(timer), next_us));
+
+    return HRTIMER_RESTART;
+}
+
+// switch all LEDs at once; LED 0 keeps its brightness, so a partial duty restarts the pwm timer
+static void led_set_leds(struct led_dev *led, u32 mask)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&led->pwm_lock, flags);
+    led->led_state = (mask & BIT(0)) ? 1 : 0;
+    led->led_mask = mask & ~BIT(0);
+
+    // LED 0 goes out at its steady level, or the first on phase when pwm takes over below
+    led_set_array(led, led->led_mask | ((led->led_state && led->pwm_on_ns) ? BIT(0) : 0));
+    if(led_pwm_needed(led))
+    {
+        led_pwm_apply(led);
+    }
+    spin_unlock_irqrestore(&led->pwm_lock, flags);
+}
+
+// stop a running pattern, process context with pattern_mutex held
+static void led_pattern_stop(struct led_dev *led)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&led->pwm_lock, flags);
+    if(led->pattern_running)
+    {
+        led_pattern_end(led);
+    }
+    spin_unlock_irqrestore(&led->pwm_lock, flags);
+
+    hrtimer_cancel(&led->pattern_timer);
+}
+
+// replace the running pattern, the blink timer is stopped while one runs
+static int led_pattern_start(struct led_dev *led, const struct led_pattern *pattern)
+{
+    unsigned long flags;
+    int i;
+
+    if(pattern->count > LED_PATTERN_MAX_STEPS)
+    {
+        return -EINVAL;
+    }
+    for(i = 0; i < pattern->count; i++)
+    {
+        if(pattern->steps[i].level > LED_PWM_LEVELS ||
+           pattern->steps[i].duration_us < LED_PATTERN_MIN_STEP_US ||
+           pattern->steps[i].duration_us > LED_PATTERN_MAX_STEP_US)
+        {
+            return -EINVAL;
+        }
+    }
+
+    mutex_lock(&led->pattern_mutex);
+
+    led_pattern_stop(led);
+    if(!pattern->count)
+    {
+        mutex_unlock(&led->pattern_mutex);
+        return 0;
+    }
+
+    del_timer_sync(&led->timer);
+
+    spin_lock_irqsave(&led->pwm_lock, flags);
+    led->pattern = *pattern;
+    led->pattern_step = 0;
+    led->pattern_loops = 0;
+    led->pattern_saved_brightness = led->brightness;
+    led->pattern_running = 1;
+    led_pattern_show_step(led);
+    hrtimer_start(&led->pattern_timer, ns_to_ktime((u64)pattern->steps[0].duration_us * NSEC_PER_USEC),
+                  HRTIMER_MODE_REL);
+    spin_unlock_irqrestore(&led->pwm_lock, flags);
+
+    mutex_unlock(&led->pattern_mutex);
+
+    return 0;
+}
 
 void led_on(struct led_dev *led)
 {
-    gpio_set_value(led->led_gpio, 0);
+    unsigned long flags;
+
+    spin_lock_irqsave(&led->pwm_lock, flags);
     led->led_state = 1;
+    led_pwm_apply(led);
+    spin_unlock_irqrestore(&led->pwm_lock, flags);
 }
 
 void led_off(struct led_dev *led)
 {
-    gpio_set_value(led->led_gpio, 1);
+    unsigned long flags;
+
+    spin_lock_irqsave(&led->pwm_lock, flags);
     led->led_state = 0;
+    led_pwm_apply(led);
+    spin_unlock_irqrestore(&led->pwm_lock, flags);
 }
 
 /* The various file operations we support. */
 int led_open (struct inode *inode, struct file *filp)
 {
-    printk(NAME " open\n");
+    DRV_DBG(NAME " open\n");
     filp->private_data = &led;
     return 0;
 }
 
 int led_release (struct inode *inode, struct file *filp)
 {
-    printk(NAME " release\n");
+    DRV_DBG(NAME " release\n");
     filp->private_data = NULL;
     return 0;
 }
@@ -100,17 +468,17 @@ ssize_t led_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
     int copy_len = 0;
     int gpio_val;
     
-    printk(NAME " read\n");
+    DRV_DBG(NAME " read\n");
 
     // read led status - use internal state instead of gpio_get_value for output pins
     gpio_val = gpio_get_value(led.led_gpio);
-    printk(NAME " gpio_get_value: %d, led_state: %d\n", gpio_val, led.led_state);
+    DRV_DBG(NAME " gpio_get_value: %d, led_state: %d\n", gpio_val, led.led_state);
     
     if(led.led_state == 1){
-        printk(NAME " led is ON\n");
+        DRV_DBG(NAME " led is ON\n");
         snprintf(read_buf, sizeof(read_buf), "LED is ON\n");
     } else {
-        printk(NAME " led is OFF\n");
+        DRV_DBG(NAME " led is OFF\n");
         snprintf(read_buf, sizeof(read_buf), "LED is OFF\n");
     }
 
@@ -119,11 +487,11 @@ ssize_t led_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
 
     ret = copy_to_user(buf, read_buf, copy_len); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_to_user failed, %d bytes not copied\n", ret);
+        DRV_DBG(NAME " copy_to_user failed, %d bytes not copied\n", ret);
         return -EFAULT;
     }
     
-    printk(NAME " read %d bytes successfully\n", copy_len);
+    DRV_DBG(NAME " read %d bytes successfully\n", copy_len);
     return copy_len;  // 返回实际读取的字节数
 }
 ssize_t led_write (struct file *filp, const char __user *buf, size_t count, loff_t *ppos)
@@ -132,27 +500,27 @@ ssize_t led_write (struct file *filp, const char __user *buf, size_t count, loff
     struct led_dev *dev = (struct led_dev *)filp->private_data;
     if(!dev) return -EINVAL;
 
-    printk(NAME " write %d\n", count);
+    DRV_DBG(NAME " write %d\n", count);
 
     if(count >= sizeof(write_buf)) count = sizeof(write_buf) - 1;
     
     ret = copy_from_user(write_buf, buf, count); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_from_user failed %d\n", ret);
+        DRV_DBG(NAME " copy_from_user failed %d\n", ret);
         return -EFAULT;
     }
 
     write_buf[count] = '\0'; // null terminate the string
-    printk(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
+    DRV_DBG(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
 
     if(strncmp(write_buf, "on", 2) == 0) {
         led_on(dev);
-        printk(NAME " led on\n");
+        DRV_DBG(NAME " led on\n");
     } else if(strncmp(write_buf, "off", 3) == 0) {
         led_off(dev);
-        printk(NAME " led off\n");
+        DRV_DBG(NAME " led off\n");
     } else {
-        printk(NAME " invalid command\n");
+        DRV_DBG(NAME " invalid command\n");
     }
 
     return count;
@@ -166,15 +534,20 @@ long led_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
     struct led_dev *led = (struct led_dev *)filp->private_data;
     if(!led) return -EINVAL;
 
-    printk(NAME " ioctl\n");
+    DRV_DBG(NAME " ioctl\n");
 
     switch(cmd) {
         case LED_ON:
+            // LED_ON/LED_OFF take the LED back from a running pattern
+            mutex_lock(&led->pattern_mutex);
+            led_pattern_stop(led);
+            mutex_unlock(&led->pattern_mutex);
+
             led_on(led);
 
             // check timer status
             if(timer_pending(&led->timer)) {
-                printk(NAME " timer pending\n");
+                DRV_DBG(NAME " timer pending\n");
                 break;
             }
 
@@ -189,18 +562,22 @@ long led_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
             led->timer.function = (void (*)(unsigned long))led_timer_func;
             add_timer(&led->timer);
 
-            printk(NAME " timer started\n");
+            DRV_DBG(NAME " timer started\n");
             
             break;
         case LED_OFF:
+            mutex_lock(&led->pattern_mutex);
+            led_pattern_stop(led);
+            mutex_unlock(&led->pattern_mutex);
+
             // stop timer
             if(timer_pending(&led->timer)) {
                 del_timer(&led->timer);
-                printk(NAME " timer stopped\n");
+                DRV_DBG(NAME " timer stopped\n");
             }
             else
             {
-                printk(NAME " timer not pending\n");
+                DRV_DBG(NAME " timer not pending\n");
             }
 
             // turn off LED
@@ -216,7 +593,7 @@ long led_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
                 // set timer period
                 period = (int)arg;
                 if(period < 100 || period > 10000) {
-                    printk(NAME " invalid period: %d\n", period);
+                    DRV_DBG(NAME " invalid period: %d\n", period);
                     return -EINVAL;
                 }
                 
@@ -225,7 +602,7 @@ long led_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
                 led->led_period = period;
                 spin_unlock_irqrestore(&led->lock, flags);
                 
-                printk(NAME " LED_SET_PERIOD:%d\n", led->led_period);
+                DRV_DBG(NAME " LED_SET_PERIOD:%d\n", led->led_period);
             }
             break;
         case LED_GET_PERIOD:
@@ -234,14 +611,79 @@ long led_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
                 spin_lock_irqsave(&led->lock, flags);
                 period = led->led_period;
                 spin_unlock_irqrestore(&led->lock, flags);
-                printk(NAME " LED_GET_PERIOD:%d\n", period);
+                DRV_DBG(NAME " LED_GET_PERIOD:%d\n", period);
                 return period;
             }
             break;
+        case LED_SET_BRIGHTNESS:
+            if((int)arg < 0 || (int)arg > LED_PWM_LEVELS) {
+                DRV_DBG(NAME " invalid brightness: %d\n", (int)arg);
+                return -EINVAL;
+            }
+            led_set_brightness(led, (int)arg);
+            break;
+        case LED_GET_BRIGHTNESS:
+            return led->brightness;
+        case LED_SET_PWM_FREQ:
+            if((int)arg < LED_PWM_FREQ_MIN || (int)arg > LED_PWM_FREQ_MAX) {
+                DRV_DBG(NAME " invalid pwm frequency: %d\n", (int)arg);
+                return -EINVAL;
+            }
+            led_set_pwm_freq(led, (int)arg);
+            break;
+        case LED_GET_PWM_FREQ:
+            return led->pwm_freq;
+        case LED_SET_LEDS:
+            if((u32)arg & ~GENMASK(led->led_num - 1, 0)) {
+                DRV_DBG(NAME " invalid led mask: 0x%lx, %d leds\n", arg, led->led_num);
+                return -EINVAL;
+            }
+
+            // like LED_OFF, the timers would overwrite LED 0
+            mutex_lock(&led->pattern_mutex);
+            led_pattern_stop(led);
+            mutex_unlock(&led->pattern_mutex);
+            del_timer_sync(&led->timer);
+
+            led_set_leds(led, (u32)arg);
+            break;
+        case LED_GET_LEDS:
+            return led->led_mask | (led->led_state ? BIT(0) : 0);
+        case LED_GET_NUM:
+            return led->led_num;
+        case LED_SET_PATTERN:
+            {
+                struct led_pattern *pattern;
+                int ret;
+
+                pattern = kmalloc(sizeof(*pattern), GFP_KERNEL);
+                if(!pattern) {
+                    return -ENOMEM;
+                }
+                if(copy_from_user(pattern, (void __user *)arg, sizeof(*pattern))) {
+                    kfree(pattern);
+                    return -EFAULT;
+                }
+
+                ret = led_pattern_start(led, pattern);
+                if(ret) {
+                    DRV_DBG(NAME " invalid pattern\n");
+                }
+                else {
+                    DRV_DBG(NAME " LED_SET_PATTERN: %u steps, repeat %u\n", pattern->count, pattern->repeat);
+                }
+                kfree(pattern);
+                if(ret) {
+                    return ret;
+                }
+            }
+            break;
         default:
-            printk(NAME " invalid ioctl cmd\n");
+            DRV_DBG(NAME " invalid ioctl cmd\n");
             return -EINVAL;
     }
+
+    return 0;
 }
 
 static const struct file_operations led_fops = {
@@ -282,6 +724,7 @@ static void led_timer_func(unsigned long data)
 static int __init led_init(void)
 {
     int rc;
+    int i = 0;
     const char *str;
     struct device_node *child;
 
@@ -319,43 +762,70 @@ static int __init led_init(void)
         printk(NAME " child node: %s\n", child->name);
     }
 
-    // get led gpio
-    led.led_gpio = of_get_named_gpio(led.np, "led-gpios", 0);
-    if(led.led_gpio < 0)
+    // get led gpios, the first one is the blink/pwm LED
+    led.led_num = of_gpio_named_count(led.np, "led-gpios");
+    if(led.led_num <= 0)
     {
-        printk(NAME " led gpio not found, error: %d\n", led.led_gpio);
+        printk(NAME " led gpio not found, error: %d\n", led.led_num);
         goto err_find_node;
     }
-    printk(NAME " led gpio: %d\n", led.led_gpio);
-
-    // check if gpio is valid
-    if(!gpio_is_valid(led.led_gpio))
+    if(led.led_num > LED_MAX_NUM)
     {
-        printk(NAME " gpio %d is not valid\n", led.led_gpio);
-        goto err_find_node;
+        printk(NAME " %d led gpios, using the first %d\n", led.led_num, LED_MAX_NUM);
+        led.led_num = LED_MAX_NUM;
     }
 
-    // try to free gpio first in case it's already requested
-    // gpio_free(led.led_gpio);
-    
-    // request gpio
-    rc = gpio_request(led.led_gpio, "led");
-    if(rc)
+    for(i = 0; i < led.led_num; i++)
     {
-        printk(NAME " gpio request failed, error: %d (EBUSY means already in use)\n", rc);
-        goto err_find_node;
-    }
+        led.led_gpios[i] = of_get_named_gpio(led.np, "led-gpios", i);
+        printk(NAME " led gpio %d: %d\n", i, led.led_gpios[i]);
 
-    // set gpio direction
-    if(gpio_direction_output(led.led_gpio, 1))
-    {
-        printk(NAME " gpio direction output failed\n");
-        goto err_gpio_request;
+        // check if gpio is valid
+        if(!gpio_is_valid(led.led_gpios[i]))
+        {
+            printk(NAME " gpio %d is not valid\n", led.led_gpios[i]);
+            goto err_gpio_request;
+        }
+
+        // request gpio
+        rc = gpio_request(led.led_gpios[i], "led");
+        if(rc)
+        {
+            printk(NAME " gpio request failed, error: %d (EBUSY means already in use)\n", rc);
+            goto err_gpio_request;
+        }
+
+        // set gpio direction, off
+        if(gpio_direction_output(led.led_gpios[i], 1))
+        {
+            printk(NAME " gpio direction output failed\n");
+            gpio_free(led.led_gpios[i]);
+            goto err_gpio_request;
+        }
+
+        led.led_descs[i] = gpio_to_desc(led.led_gpios[i]);
     }
+    led.led_gpio = led.led_gpios[0];
+    led.led_mask = 0;
 
     // set gpio value
     // gpio_set_value(led.led_gpio, 0);
 
+    // init software pwm, full brightness until told otherwise
+    spin_lock_init(&led.pwm_lock);
+    hrtimer_init(&led.pwm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    led.pwm_timer.function = led_pwm_timer_func;
+    led.brightness = LED_PWM_LEVELS;
+    led.pwm_freq = LED_PWM_FREQ_DEFAULT;
+    led.pwm_running = 0;
+    led_pwm_update(&led);
+
+    // init pattern sequencer
+    hrtimer_init(&led.pattern_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    led.pattern_timer.function = led_pattern_timer_func;
+    mutex_init(&led.pattern_mutex);
+    led.pattern_running = 0;
+
     led_off(&led);
 
     // init spinlock and period
@@ -377,7 +847,7 @@ static int __init led_init(void)
         rc = register_chrdev_region(led.devid, LED_COUNT, NAME);
         if(rc < 0) {
             printk(NAME " register_chrdev_region failed\n");
-            goto err_gpio_request;
+            goto err_timer;
         }
     }
     else
@@ -385,7 +855,7 @@ static int __init led_init(void)
         rc = alloc_chrdev_region(&led.devid, 0, LED_COUNT, NAME);
         if(rc < 0) {
             printk(NAME " alloc_chrdev_region failed\n");
-            goto err_gpio_request;
+            goto err_timer;
         }
 
         led.major = MAJOR(led.devid);
@@ -416,16 +886,38 @@ static int __init led_init(void)
         goto err_class;
     }
 
+    // led class device
+    led.led_cdev.name = NAME;
+    led.led_cdev.max_brightness = LED_PWM_LEVELS;
+    led.led_cdev.brightness_set = led_cdev_brightness_set;
+    led.led_cdev.brightness_get = led_cdev_brightness_get;
+    rc = led_classdev_register(led.led_device, &led.led_cdev);
+    if(rc) {
+        printk(NAME " led_classdev_register failed\n");
+        goto err_device;
+    }
+
 	return 0;
 
+err_device:
+    device_destroy(led.led_class, led.devid);
 err_class:
     class_destroy(led.led_class);
 err_cdev:
     cdev_del(&led.cdev);
 err_chrdev:
     unregister_chrdev_region(led.devid, LED_COUNT);
+err_timer:
+    del_timer_sync(&led.timer);
+    hrtimer_cancel(&led.pattern_timer);
+    led_off(&led);
+    hrtimer_cancel(&led.pwm_timer);
+    i = led.led_num;
 err_gpio_request:
-    gpio_free(led.led_gpio);
+    while(--i >= 0)
+    {
+        gpio_free(led.led_gpios[i]);
+    }
 
 err_find_node:
     return -ENODEV;
@@ -433,10 +925,20 @@ err_find_node:
 
 static void __exit led_exit(void)
 {
+    int i;
+
 	// printk(KERN_DEBUG NAME " exit\n");
 	printk(NAME " exit\n");
 
+    led_classdev_unregister(&led.led_cdev);
+
+    // stop the pattern and the blink timer first, they would turn the LED back on
+    mutex_lock(&led.pattern_mutex);
+    led_pattern_stop(&led);
+    mutex_unlock(&led.pattern_mutex);
+    del_timer_sync(&led.timer);
     led_off(&led);
+    hrtimer_cancel(&led.pwm_timer);
 
     // cleanup in reverse order of initialization
     device_destroy(led.led_class, led.devid);
@@ -444,11 +946,12 @@ static void __exit led_exit(void)
     cdev_del(&led.cdev);
     unregister_chrdev_region(led.devid, LED_COUNT);
 
-    // gpio free
-    gpio_free(led.led_gpio);
-
-    // deletee timer
-    del_timer_sync(&led.timer);
+    // all LEDs off, then gpio free
+    led_set_array(&led, 0);
+    for(i = 0; i < led.led_num; i++)
+    {
+        gpio_free(led.led_gpios[i]);
+    }
 }
 
 module_init(led_init);
@@ -11,6 +11,38 @@
 #define LED_GET_STATE   _IOR(LED_IOCTL_MAGIC, 2, int)
 #define LED_SET_PERIOD  _IOW(LED_IOCTL_MAGIC, 3, int)
 #define LED_GET_PERIOD  _IOR(LED_IOCTL_MAGIC, 4, int)
+#define LED_SET_BRIGHTNESS  _IOW(LED_IOCTL_MAGIC, 5, int)
+#define LED_GET_BRIGHTNESS  _IOR(LED_IOCTL_MAGIC, 6, int)
+#define LED_SET_PWM_FREQ    _IOW(LED_IOCTL_MAGIC, 7, int)
+#define LED_GET_PWM_FREQ    _IOR(LED_IOCTL_MAGIC, 8, int)
+
+#define LED_PATTERN_MAX_STEPS   32
+
+struct led_pattern_step {
+    unsigned short level;
+    unsigned short reserved;
+    unsigned int duration_us;
+};
+
+struct led_pattern {
+    unsigned int count;
+    unsigned int repeat;
+    struct led_pattern_step steps[LED_PATTERN_MAX_STEPS];
+};
+
+#define LED_SET_PATTERN     _IOW(LED_IOCTL_MAGIC, 9, struct led_pattern)
+
+#define LED_SET_LEDS    _IOW(LED_IOCTL_MAGIC, 10, int)
+#define LED_GET_LEDS    _IOR(LED_IOCTL_MAGIC, 11, int)
+#define LED_GET_NUM     _IOR(LED_IOCTL_MAGIC, 12, int)
+
+// heartbeat: strong beat, weak beat, long pause
+static const struct led_pattern_step heartbeat[] = {
+    { 255, 0, 100000 },
+    {   0, 0, 100000 },
+    {  64, 0, 100000 },
+    {   0, 0, 700000 },
+};
 
 /*
 *
@@ -101,9 +133,17 @@ int main(int argc, char *argv[])
             printf("3: Get LED state\n");
             printf("4: Set LED period\n");
             printf("5: Get LED period\n");
+            printf("6: Set LED brightness (0-255)\n");
+            printf("7: Get LED brightness\n");
+            printf("8: Set PWM frequency (50-2000 Hz)\n");
+            printf("9: Get PWM frequency\n");
+            printf("10: Run heartbeat pattern\n");
+            printf("11: Stop pattern\n");
+            printf("12: Set all LEDs (bit mask, hex)\n");
+            printf("13: Get all LEDs\n");
             printf("0: Exit\n");
 
-            printf("Enter command (0-5): ");
+            printf("Enter command (0-13): ");
             ret = scanf("%d", &ioctl_cmd);
             if(ret != 1)
             {
@@ -193,6 +233,118 @@ int main(int argc, char *argv[])
                     printf("LED period: %d\n", ret);
                 }
             }
+            else if(ioctl_cmd == 6 || ioctl_cmd == 8)
+            {
+                int value = 0;
+
+                printf("please input %s\n", ioctl_cmd == 6 ? "brightness" : "frequency");
+                ret = scanf("%d", &value);
+                if(ret != 1)
+                {
+                    // 清理输入缓冲区
+                    int c;
+                    while((c = getchar()) != '\n' && c != EOF);
+                    printf("Invalid input, please enter a number\n");
+                    continue;
+                }
+
+                ret = ioctl(fd, ioctl_cmd == 6 ? LED_SET_BRIGHTNESS : LED_SET_PWM_FREQ, value);
+                if(ret < 0)
+                {
+                    printf("Failed to set LED %s\n", ioctl_cmd == 6 ? "brightness" : "PWM frequency");
+                }
+                else
+                {
+                    printf("Set LED %s\n", ioctl_cmd == 6 ? "brightness" : "PWM frequency");
+                }
+            }
+            else if(ioctl_cmd == 7 || ioctl_cmd == 9)
+            {
+                ret = ioctl(fd, ioctl_cmd == 7 ? LED_GET_BRIGHTNESS : LED_GET_PWM_FREQ);
+                if(ret < 0)
+                {
+                    printf("Failed to get LED %s\n", ioctl_cmd == 7 ? "brightness" : "PWM frequency");
+                }
+                else
+                {
+                    printf("LED %s: %d\n", ioctl_cmd == 7 ? "brightness" : "PWM frequency", ret);
+                }
+            }
+            else if(ioctl_cmd == 10 || ioctl_cmd == 11)
+            {
+                struct led_pattern pattern;
+                int repeat = 0;
+
+                memset(&pattern, 0, sizeof(pattern));
+                if(ioctl_cmd == 10)
+                {
+                    printf("please input repeat count (0 = forever)\n");
+                    ret = scanf("%d", &repeat);
+                    if(ret != 1 || repeat < 0)
+                    {
+                        // 清理输入缓冲区
+                        int c;
+                        while((c = getchar()) != '\n' && c != EOF);
+                        printf("Invalid input, please enter a number\n");
+                        continue;
+                    }
+
+                    pattern.count = sizeof(heartbeat) / sizeof(heartbeat[0]);
+                    pattern.repeat = repeat;
+                    memcpy(pattern.steps, heartbeat, sizeof(heartbeat));
+                }
+
+                // count 0 stops the running pattern
+                ret = ioctl(fd, LED_SET_PATTERN, &pattern);
+                if(ret < 0)
+                {
+                    printf("Failed to %s pattern\n", ioctl_cmd == 10 ? "start" : "stop");
+                }
+                else
+                {
+                    printf("%s pattern\n", ioctl_cmd == 10 ? "Started" : "Stopped");
+                }
+            }
+            else if(ioctl_cmd == 12)
+            {
+                unsigned int mask = 0;
+
+                printf("please input LED mask, bit n = LED n (e.g. 5 = LED 0 and 2)\n");
+                ret = scanf("%x", &mask);
+                if(ret != 1)
+                {
+                    // 清理输入缓冲区
+                    int c;
+                    while((c = getchar()) != '\n' && c != EOF);
+                    printf("Invalid input, please enter a hex number\n");
+                    continue;
+                }
+
+                // one syscall for the whole bar
+                ret = ioctl(fd, LED_SET_LEDS, mask);
+                if(ret < 0)
+                {
+                    printf("Failed to set LEDs\n");
+                }
+                else
+                {
+                    printf("Set LEDs to 0x%x\n", mask);
+                }
+            }
+            else if(ioctl_cmd == 13)
+            {
+                int num = ioctl(fd, LED_GET_NUM);
+
+                ret = ioctl(fd, LED_GET_LEDS);
+                if(ret < 0 || num < 0)
+                {
+                    printf("Failed to get LEDs\n");
+                }
+                else
+                {
+                    printf("%d LEDs, mask 0x%x\n", num, ret);
+                }
+            }
             else
             {
                 printf("Invalid command\n");
@@ -26,8 +26,15 @@
 #include <linux/atomic.h> // atomic_t
 #include <linux/interrupt.h>
 #include <linux/irq.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/poll.h>
+#include <linux/ktime.h>
 
 
+#include "key_sample.h"
+#include "drv_debug.h"
+
 #define NAME "key_irq"
 #define CHAR_DEV_BASE_MAJOR 100
 
@@ -36,6 +43,8 @@
 
 #define KEY_DEBOUNCE_TIME_MS 10
 
+struct key_dev;
+
 struct key_desc{
     int gpio;
     int irq_num;
@@ -48,6 +57,12 @@ struct key_desc{
     irqreturn_t (*irq_handler)(int, void *);
 
     struct timer_list timer;    // timer for key debounce
+
+    u64 irq_ns;         // first hard irq of the current debounce window, 0: none
+    u64 sample_irq_ns;  // irq_ns of the published value
+    u64 report_ns;      // when the timer published the value
+
+    struct key_dev *dev;
 };
 
 struct key_dev{
@@ -59,6 +74,9 @@ struct key_dev{
     struct device_node *np;     // device node
 
     struct key_desc key_descs[KEY_COUNT];
+
+    wait_queue_head_t wq;       // readers and poll waiters
+    struct fasync_struct *fasync; // SIGIO subscribers
 };
 
 struct key_dev key;
@@ -67,10 +85,12 @@ char read_buf[100];
 char write_buf[100];
 
 
+static int key_fasync(int fd, struct file *filp, int on);
+
 /* The various file operations we support. */
 int key_open (struct inode *inode, struct file *filp)
 {
-    printk(NAME " open\n");
+    DRV_DBG(NAME " open\n");
     filp->private_data = &key;
 
     return 0;
@@ -78,30 +98,62 @@ int key_open (struct inode *inode, struct file *filp)
 
 int key_release (struct inode *inode, struct file *filp)
 {
-    printk(NAME " release\n");
+    DRV_DBG(NAME " release\n");
+    key_fasync(-1, filp, 0);
     filp->private_data = NULL;
 
     return 0;
 }
 
+static int is_any_key_ready(struct key_dev *dev)
+{
+    int i;
+
+    for(i=0;i<KEY_COUNT;i++)
+    {
+        if(atomic_read(&dev->key_descs[i].key_read_flag) == 1)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 ssize_t key_read (struct file *filp, char __user *buf, size_t count, loff_t *ppos)
 {
     int ret = 0;
     int data_len = 0;
     int copy_len = 0;
-    int gpio_val[2]; //[0] - key id, [1] - key value
+    struct key_sample sample;
 
     int i;
 
     struct key_dev *dev = (struct key_dev *)filp->private_data;
+
+    if(!is_any_key_ready(dev))
+    {
+        if(filp->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+
+        // wait event
+        if(wait_event_interruptible(dev->wq, is_any_key_ready(dev)))
+        {
+            return -ERESTARTSYS;
+        }
+    }
     
     for(i=0;i<KEY_COUNT;i++)
     {
-        if(atomic_read(&key.key_descs[i].key_read_flag) == 1)
+        if(atomic_read(&dev->key_descs[i].key_read_flag) == 1)
         {
-            gpio_val[0] = i;
-            gpio_val[1] = atomic_read(&key.key_descs[i].key_state);
-            atomic_set(&key.key_descs[i].key_read_flag, 0);
+            sample.id = i;
+            sample.value = atomic_read(&dev->key_descs[i].key_state);
+            sample.irq_ns = dev->key_descs[i].sample_irq_ns;
+            sample.report_ns = dev->key_descs[i].report_ns;
+            atomic_set(&dev->key_descs[i].key_read_flag, 0);
 
             break;
         }
@@ -112,12 +164,12 @@ ssize_t key_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
         return 0;
     }
 
-    data_len = sizeof(gpio_val);
+    data_len = sizeof(sample);
     copy_len = count < data_len ? count : data_len;
 
-    ret = copy_to_user(buf, &gpio_val, copy_len); // ret fail bytes
+    ret = copy_to_user(buf, &sample, copy_len); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_to_user failed, %d bytes not copied\n", ret);
+        DRV_DBG(NAME " copy_to_user failed, %d bytes not copied\n", ret);
         return -EFAULT;
     }
     
@@ -126,11 +178,36 @@ ssize_t key_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
     return copy_len;  // 返回实际读取的字节数
 }
 
+// key poll function
+static unsigned int key_poll(struct file *filp, struct poll_table_struct *wait)
+{
+    unsigned int mask = 0;
+    struct key_dev *dev = (struct key_dev *)filp->private_data;
+
+    poll_wait(filp, &dev->wq, wait);
+
+    if(is_any_key_ready(dev))
+    {
+        mask |= POLLIN | POLLRDNORM;
+    }
+
+    return mask;
+}
+
+static int key_fasync(int fd, struct file *filp, int on)
+{
+    struct key_dev *dev = (struct key_dev *)filp->private_data;
+
+    return fasync_helper(fd, filp, on, &dev->fasync);
+}
+
 static const struct file_operations key_fops = {
 	.owner		= THIS_MODULE,
     .open      = key_open,
     .release   = key_release,
-    .read      = key_read
+    .read      = key_read,
+    .poll      = key_poll,
+    .fasync    = key_fasync,
 };
 
 // timer handler function
@@ -147,9 +224,16 @@ static void key_timer_handler(unsigned long data)
         atomic_set(&key->key_state, 1);
     }
 
+    key->sample_irq_ns = key->irq_ns;
+    key->irq_ns = 0;
+    key->report_ns = ktime_get_ns();
     atomic_set(&key->key_read_flag, 1);
 
-    printk(NAME " timer handler, %s state: %d\n", key->name, atomic_read(&key->key_state));
+    // wake up readers and poll waiters, signal fasync subscribers
+    wake_up_interruptible(&key->dev->wq);
+    kill_fasync(&key->dev->fasync, SIGIO, POLL_IN);
+
+    DRV_DBG(NAME " timer handler, %s state: %d\n", key->name, atomic_read(&key->key_state));
 }
 
 
@@ -158,6 +242,12 @@ static irqreturn_t key_irq_handler(int irq, void *key_desc)
 {
     struct key_desc *key = (struct key_desc *)key_desc;
 
+    // latency reference: the first edge of this debounce window
+    if(!key->irq_ns)
+    {
+        key->irq_ns = ktime_get_ns();
+    }
+
     // start timer
     mod_timer(&key->timer, jiffies + msecs_to_jiffies(KEY_DEBOUNCE_TIME_MS));
     // printk(NAME " %s irq, start timer\n", key->name);
@@ -185,10 +275,15 @@ static int __init key_init(void)
         atomic_set(&key.key_descs[i].key_read_flag, 0);
     }
 
+    // init wait queue head
+    init_waitqueue_head(&key.wq);
+
     // init timer
     for(i=0;i<KEY_COUNT;i++)
     {
         init_timer(&key.key_descs[i].timer);
+        key.key_descs[i].irq_ns = 0;
+        key.key_descs[i].dev = &key;
         key.key_descs[i].timer.function = key_timer_handler;
         key.key_descs[i].timer.data = (unsigned long)&key.key_descs[i];
     }
@@ -0,0 +1,355 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+#include "key_sample.h"
+
+/*
+ * Edge-to-userspace latency of the key_irq (timer), key_irq_tasklet and
+ * key_irq_work modules, per wakeup method. The three modules share the
+ * key and its gpio, so load one at a time and run this against its node:
+ *
+ *   ./key_latency_app /dev/key_irq_tasklet -m all -n 200 -g 4
+ *
+ * key_irq_work takes defer=work|highpri|thread at insmod time, so the
+ * system workqueue, a WQ_HIGHPRI workqueue and a threaded irq can be
+ * compared on the same node.
+ *
+ *   -m read|poll|epoll|sigio|all   wakeup method (default all)
+ *   -n N                           samples per method (default 100)
+ *   -g GPIO                        drive edges on this output gpio (sysfs
+ *                                  number), looped back to the key input;
+ *                                  without it, press the key by hand
+ *   -p MS                          time each level is held (default 40,
+ *                                  keep it above the 10 ms debounce)
+ *
+ * For every event it prints p50/p90/p99/max of
+ *   total  - hard irq to the reader holding the value
+ *   kernel - hard irq to the debounce timer publishing it (deferral
+ *            hop + debounce)
+ *   wakeup - publishing to the reader running
+ */
+
+#define MAX_SAMPLES 10000
+
+enum method { M_READ, M_POLL, M_EPOLL, M_SIGIO, M_COUNT };
+static const char *method_names[M_COUNT] = { "read", "poll", "epoll", "sigio" };
+
+struct stat_set {
+    int n;
+    uint64_t total[MAX_SAMPLES];
+    uint64_t kernel[MAX_SAMPLES];
+    uint64_t wakeup[MAX_SAMPLES];
+};
+
+static struct stat_set stats;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void print_row(const char *name, uint64_t *v, int n)
+{
+    qsort(v, n, sizeof(v[0]), cmp_u64);
+    printf("  %-7s p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f us\n", name,
+           v[n / 2] / 1000.0, v[n * 90 / 100] / 1000.0,
+           v[n * 99 / 100] / 1000.0, v[n - 1] / 1000.0);
+}
+
+// read everything queued, all with the same receipt time
+static int drain(int fd, uint64_t receipt)
+{
+    struct key_sample s;
+    int got = 0;
+
+    while(read(fd, &s, sizeof(s)) == sizeof(s))
+    {
+        if(!s.irq_ns || stats.n >= MAX_SAMPLES)
+        {
+            continue;
+        }
+        stats.total[stats.n] = receipt - s.irq_ns;
+        stats.kernel[stats.n] = s.report_ns - s.irq_ns;
+        stats.wakeup[stats.n] = receipt - s.report_ns;
+        stats.n++;
+        got++;
+    }
+
+    return got;
+}
+
+static int run_method(const char *path, enum method m, int samples)
+{
+    struct epoll_event ev;
+    struct pollfd pfd;
+    sigset_t set;
+    int epfd = -1;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_NONBLOCK);
+    if(fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+
+    // stale events from a previous method
+    drain(fd, now_ns());
+    stats.n = 0;
+
+    if(m == M_EPOLL)
+    {
+        epfd = epoll_create1(0);
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    else if(m == M_SIGIO)
+    {
+        sigemptyset(&set);
+        sigaddset(&set, SIGIO);
+        sigprocmask(SIG_BLOCK, &set, NULL);
+        fcntl(fd, F_SETOWN, getpid());
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | FASYNC);
+    }
+    else if(m == M_READ)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    }
+
+    while(stats.n < samples)
+    {
+        struct key_sample s;
+        uint64_t receipt;
+
+        switch(m)
+        {
+            case M_READ:
+                // one blocking read per event, the receipt time is its own
+                if(read(fd, &s, sizeof(s)) != sizeof(s))
+                {
+                    continue;
+                }
+                receipt = now_ns();
+                if(s.irq_ns)
+                {
+                    stats.total[stats.n] = receipt - s.irq_ns;
+                    stats.kernel[stats.n] = s.report_ns - s.irq_ns;
+                    stats.wakeup[stats.n] = receipt - s.report_ns;
+                    stats.n++;
+                }
+                continue;
+
+            case M_POLL:
+                pfd.fd = fd;
+                pfd.events = POLLIN;
+                if(poll(&pfd, 1, -1) <= 0)
+                {
+                    continue;
+                }
+                break;
+
+            case M_EPOLL:
+                if(epoll_wait(epfd, &ev, 1, -1) <= 0)
+                {
+                    continue;
+                }
+                break;
+
+            case M_SIGIO:
+                if(sigwaitinfo(&set, NULL) < 0)
+                {
+                    continue;
+                }
+                break;
+
+            default:
+                break;
+        }
+
+        drain(fd, now_ns());
+    }
+
+    if(m == M_SIGIO)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~FASYNC);
+        sigprocmask(SIG_UNBLOCK, &set, NULL);
+    }
+    if(epfd >= 0)
+    {
+        close(epfd);
+    }
+    close(fd);
+
+    printf("%s, %s, %d events\n", path, method_names[m], stats.n);
+    print_row("total", stats.total, stats.n);
+    print_row("kernel", stats.kernel, stats.n);
+    print_row("wakeup", stats.wakeup, stats.n);
+
+    return 0;
+}
+
+static int sysfs_write(const char *path, const char *val)
+{
+    int fd = open(path, O_WRONLY);
+    int ret;
+
+    if(fd < 0)
+    {
+        return -1;
+    }
+    ret = write(fd, val, strlen(val));
+    close(fd);
+
+    return ret < 0 ? -1 : 0;
+}
+
+// child process: square wave on the loopback gpio until killed
+static pid_t start_driver(int gpio, int hold_ms)
+{
+    char path[64];
+    char num[16];
+    pid_t pid;
+    int fd;
+    int level = 0;
+    struct timespec hold = { hold_ms / 1000, (hold_ms % 1000) * 1000000L };
+
+    snprintf(num, sizeof(num), "%d", gpio);
+    sysfs_write("/sys/class/gpio/export", num);     // EBUSY if already exported
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/direction", gpio);
+    if(sysfs_write(path, "high") < 0)
+    {
+        printf("Failed to set gpio%d as output\n", gpio);
+        return -1;
+    }
+
+    pid = fork();
+    if(pid != 0)
+    {
+        return pid;
+    }
+
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", gpio);
+    fd = open(path, O_WRONLY);
+    if(fd < 0)
+    {
+        _exit(1);
+    }
+    while(1)
+    {
+        nanosleep(&hold, NULL);
+        if(pwrite(fd, level ? "1" : "0", 1, 0) < 0)
+        {
+            _exit(1);
+        }
+        level = !level;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path;
+    int method = -1;
+    int samples = 100;
+    int gpio = -1;
+    int hold_ms = 40;
+    pid_t driver = -1;
+    int opt;
+    int m;
+
+    if(argc < 2 || argv[1][0] == '-')
+    {
+        printf("Usage: %s <device_file> [-m read|poll|epoll|sigio|all] [-n samples] [-g gpio] [-p hold_ms]\n", argv[0]);
+        return -1;
+    }
+    path = argv[1];
+    optind = 2;
+
+    while((opt = getopt(argc, argv, "m:n:g:p:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'm':
+                for(m = 0; m < M_COUNT; m++)
+                {
+                    if(!strcmp(optarg, method_names[m]))
+                    {
+                        method = m;
+                    }
+                }
+                if(method < 0 && strcmp(optarg, "all"))
+                {
+                    printf("Unknown method %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'n':
+                samples = atoi(optarg);
+                break;
+            case 'g':
+                gpio = atoi(optarg);
+                break;
+            case 'p':
+                hold_ms = atoi(optarg);
+                break;
+            default:
+                return -1;
+        }
+    }
+    if(samples < 1 || samples > MAX_SAMPLES)
+    {
+        samples = samples < 1 ? 1 : MAX_SAMPLES;
+    }
+
+    if(gpio >= 0)
+    {
+        driver = start_driver(gpio, hold_ms);
+        if(driver < 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        printf("No -g: press the key %d times per method\n", samples);
+    }
+
+    for(m = 0; m < M_COUNT; m++)
+    {
+        if(method >= 0 && m != method)
+        {
+            continue;
+        }
+        run_method(path, m, samples);
+    }
+
+    if(driver > 0)
+    {
+        kill(driver, SIGTERM);
+        waitpid(driver, NULL, 0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef _KEY_SAMPLE_H
+#define _KEY_SAMPLE_H
+
+#include <linux/types.h>
+
+/*
+ * What read() returns. id/value keep the layout of the old int[2], so a
+ * reader that asks for 8 bytes sees no difference. The timestamps let
+ * key_latency_app split edge-to-userspace latency into the deferral and
+ * debounce part (report_ns - irq_ns) and the wakeup part (receipt -
+ * report_ns).
+ */
+struct key_sample {
+    __s32 id;           // key index
+    __s32 value;        // 0: pressed; 1: not pressed
+    __u64 irq_ns;       // CLOCK_MONOTONIC, first hard irq of this debounce window
+    __u64 report_ns;    // CLOCK_MONOTONIC, debounce timer published the value
+};
+
+#endif // _KEY_SAMPLE_H
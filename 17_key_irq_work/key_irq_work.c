@@ -26,9 +26,18 @@
 #include <linux/atomic.h> // atomic_t
 #include <linux/interrupt.h>
 #include <linux/irq.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/poll.h>
+#include <linux/ktime.h>
 #include <linux/workqueue.h>
+#include <linux/delay.h>  // usleep_range
+#include <linux/moduleparam.h>
 
 
+#include "key_sample.h"
+#include "drv_debug.h"
+
 #define NAME "key_irq_work"
 #define CHAR_DEV_BASE_MAJOR 100
 
@@ -37,6 +46,26 @@
 
 #define KEY_DEBOUNCE_TIME_MS 10
 
+/*
+ * Where the hard irq hands off to:
+ *   work    - schedule_work() on the shared system workqueue, then the timer
+ *   highpri - queue_work() on a dedicated WQ_HIGHPRI workqueue, then the timer
+ *   thread  - threaded irq with IRQF_ONESHOT; the irq/N-key0 kthread
+ *             (SCHED_FIFO) sleeps out the bounce with the line masked and
+ *             publishes itself, no workqueue or timer hop
+ */
+static char *defer = "work";
+module_param(defer, charp, 0444);
+MODULE_PARM_DESC(defer, "Bottom half: work, highpri or thread");
+
+enum key_defer_mode {
+    KEY_DEFER_WORK,
+    KEY_DEFER_HIGHPRI,
+    KEY_DEFER_THREAD,
+};
+
+struct key_dev;
+
 struct key_desc{
     int gpio;
     int irq_num;
@@ -49,6 +78,12 @@ struct key_desc{
     irqreturn_t (*irq_handler)(int, void *);
 
     struct timer_list timer;    // timer for key debounce
+
+    u64 irq_ns;         // first hard irq of the current debounce window, 0: none
+    u64 sample_irq_ns;  // irq_ns of the published value
+    u64 report_ns;      // when the timer published the value
+
+    struct key_dev *dev;
     // struct tasklet_struct tasklet;
     struct work_struct work;
 };
@@ -62,6 +97,12 @@ struct key_dev{
     struct device_node *np;     // device node
 
     struct key_desc key_descs[KEY_COUNT];
+
+    wait_queue_head_t wq;       // readers and poll waiters
+    struct fasync_struct *fasync; // SIGIO subscribers
+
+    enum key_defer_mode defer_mode;
+    struct workqueue_struct *workqueue; // KEY_DEFER_HIGHPRI only
 };
 
 struct key_dev key;
@@ -70,10 +111,12 @@ char read_buf[100];
 char write_buf[100];
 
 
+static int key_fasync(int fd, struct file *filp, int on);
+
 /* The various file operations we support. */
 int key_open (struct inode *inode, struct file *filp)
 {
-    printk(NAME " open\n");
+    DRV_DBG(NAME " open\n");
     filp->private_data = &key;
 
     return 0;
@@ -81,29 +124,61 @@ int key_open (struct inode *inode, struct file *filp)
 
 int key_release (struct inode *inode, struct file *filp)
 {
-    printk(NAME " release\n");
+    DRV_DBG(NAME " release\n");
+    key_fasync(-1, filp, 0);
     filp->private_data = NULL;
 
     return 0;
 }
 
+static int is_any_key_ready(struct key_dev *dev)
+{
+    int i;
+
+    for(i=0;i<KEY_COUNT;i++)
+    {
+        if(atomic_read(&dev->key_descs[i].key_read_flag) == 1)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 ssize_t key_read (struct file *filp, char __user *buf, size_t count, loff_t *ppos)
 {
     int ret = 0;
     int data_len = 0;
     int copy_len = 0;
-    int gpio_val[2]; //[0] - key id, [1] - key value
+    struct key_sample sample;
 
     int i;
 
     struct key_dev *dev = (struct key_dev *)filp->private_data;
+
+    if(!is_any_key_ready(dev))
+    {
+        if(filp->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+
+        // wait event
+        if(wait_event_interruptible(dev->wq, is_any_key_ready(dev)))
+        {
+            return -ERESTARTSYS;
+        }
+    }
     
     for(i=0;i<KEY_COUNT;i++)
     {
         if(atomic_read(&dev->key_descs[i].key_read_flag) == 1)
         {
-            gpio_val[0] = i;
-            gpio_val[1] = atomic_read(&dev->key_descs[i].key_state);
+            sample.id = i;
+            sample.value = atomic_read(&dev->key_descs[i].key_state);
+            sample.irq_ns = dev->key_descs[i].sample_irq_ns;
+            sample.report_ns = dev->key_descs[i].report_ns;
             atomic_set(&dev->key_descs[i].key_read_flag, 0);
 
             break;
@@ -115,12 +190,12 @@ ssize_t key_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
         return 0;
     }
 
-    data_len = sizeof(gpio_val);
+    data_len = sizeof(sample);
     copy_len = count < data_len ? count : data_len;
 
-    ret = copy_to_user(buf, &gpio_val, copy_len); // ret fail bytes
+    ret = copy_to_user(buf, &sample, copy_len); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_to_user failed, %d bytes not copied\n", ret);
+        DRV_DBG(NAME " copy_to_user failed, %d bytes not copied\n", ret);
         return -EFAULT;
     }
     
@@ -129,18 +204,41 @@ ssize_t key_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
     return copy_len;  // 返回实际读取的字节数
 }
 
+// key poll function
+static unsigned int key_poll(struct file *filp, struct poll_table_struct *wait)
+{
+    unsigned int mask = 0;
+    struct key_dev *dev = (struct key_dev *)filp->private_data;
+
+    poll_wait(filp, &dev->wq, wait);
+
+    if(is_any_key_ready(dev))
+    {
+        mask |= POLLIN | POLLRDNORM;
+    }
+
+    return mask;
+}
+
+static int key_fasync(int fd, struct file *filp, int on)
+{
+    struct key_dev *dev = (struct key_dev *)filp->private_data;
+
+    return fasync_helper(fd, filp, on, &dev->fasync);
+}
+
 static const struct file_operations key_fops = {
 	.owner		= THIS_MODULE,
     .open      = key_open,
     .release   = key_release,
-    .read      = key_read
+    .read      = key_read,
+    .poll      = key_poll,
+    .fasync    = key_fasync,
 };
 
-// timer handler function
-static void key_timer_handler(unsigned long data)
+// sample the key and hand the value to readers
+static void key_publish(struct key_desc *key)
 {
-    struct key_desc *key = (struct key_desc *)data;
-
     if(gpio_get_value(key->gpio) == 0)
     {
         atomic_set(&key->key_state, 0);
@@ -150,9 +248,24 @@ static void key_timer_handler(unsigned long data)
         atomic_set(&key->key_state, 1);
     }
 
+    key->sample_irq_ns = key->irq_ns;
+    key->irq_ns = 0;
+    key->report_ns = ktime_get_ns();
     atomic_set(&key->key_read_flag, 1);
 
-    printk(NAME " timer handler, %s state: %d\n", key->name, atomic_read(&key->key_state));
+    // wake up readers and poll waiters, signal fasync subscribers
+    wake_up_interruptible(&key->dev->wq);
+    kill_fasync(&key->dev->fasync, SIGIO, POLL_IN);
+}
+
+// timer handler function
+static void key_timer_handler(unsigned long data)
+{
+    struct key_desc *key = (struct key_desc *)data;
+
+    key_publish(key);
+
+    DRV_DBG(NAME " timer handler, %s state: %d\n", key->name, atomic_read(&key->key_state));
 }
 
 // tasklet handler function
@@ -163,7 +276,7 @@ static void key_tasklet_handler(unsigned long data)
     // start timer
     mod_timer(&key->timer, jiffies + msecs_to_jiffies(KEY_DEBOUNCE_TIME_MS));
 
-    printk(NAME " tasklet handler, %s start timer.\n", key->name);
+    DRV_DBG(NAME " tasklet handler, %s start timer.\n", key->name);
 }
 
 // work handler function
@@ -174,7 +287,7 @@ static void key_work_handler(struct work_struct *work)
     // start timer
     mod_timer(&key->timer, jiffies + msecs_to_jiffies(KEY_DEBOUNCE_TIME_MS));
 
-    printk(NAME " work handler, %s start timer.\n", key->name);
+    DRV_DBG(NAME " work handler, %s start timer.\n", key->name);
 }
 
 // irq handler - key_irq_handler
@@ -182,11 +295,53 @@ static irqreturn_t key_irq_handler(int irq, void *key_desc)
 {
     struct key_desc *key = (struct key_desc *)key_desc;
 
+    // latency reference: the first edge of this debounce window
+    if(!key->irq_ns)
+    {
+        key->irq_ns = ktime_get_ns();
+    }
+
     // tasklet
     // tasklet_schedule(&key->tasklet);
 
-    // work
-    schedule_work(&key->work);
+    switch(key->dev->defer_mode)
+    {
+        case KEY_DEFER_THREAD:
+            return IRQ_WAKE_THREAD;
+
+        case KEY_DEFER_HIGHPRI:
+            queue_work(key->dev->workqueue, &key->work);
+            break;
+
+        default:
+            schedule_work(&key->work);
+            break;
+    }
+
+    return IRQ_HANDLED;
+}
+
+// threaded irq handler - runs in the irq kthread, the line stays masked until it returns
+static irqreturn_t key_irq_thread(int irq, void *key_desc)
+{
+    struct key_desc *key = (struct key_desc *)key_desc;
+
+    // debounce: bounce edges are held off by IRQF_ONESHOT while we sleep
+    usleep_range(KEY_DEBOUNCE_TIME_MS * 1000, KEY_DEBOUNCE_TIME_MS * 1000 + 500);
+
+    /*
+     * An edge latched while the line was masked replays once after we
+     * return and finds the level already published, don't report it twice.
+     */
+    if((gpio_get_value(key->gpio) ? 1 : 0) == atomic_read(&key->key_state))
+    {
+        key->irq_ns = 0;
+        return IRQ_HANDLED;
+    }
+
+    key_publish(key);
+
+    DRV_DBG(NAME " irq thread, %s state: %d\n", key->name, atomic_read(&key->key_state));
 
     return IRQ_HANDLED;
 }
@@ -211,10 +366,34 @@ static int __init key_init(void)
         atomic_set(&key.key_descs[i].key_read_flag, 0);
     }
 
-    // init timer
+    // init wait queue head
+    init_waitqueue_head(&key.wq);
+
+    // bottom half
+    if(!strcmp(defer, "thread"))
+    {
+        key.defer_mode = KEY_DEFER_THREAD;
+    }
+    else if(!strcmp(defer, "highpri"))
+    {
+        key.defer_mode = KEY_DEFER_HIGHPRI;
+    }
+    else
+    {
+        key.defer_mode = KEY_DEFER_WORK;
+    }
+    printk(NAME " defer: %s\n", key.defer_mode == KEY_DEFER_THREAD ? "thread" :
+                                key.defer_mode == KEY_DEFER_HIGHPRI ? "highpri" : "work");
+
+    key.workqueue = NULL;
+
+    // init timer and work, before any irq can queue them or an error path flushes them
     for(i=0;i<KEY_COUNT;i++)
     {
+        INIT_WORK(&key.key_descs[i].work, key_work_handler);
         init_timer(&key.key_descs[i].timer);
+        key.key_descs[i].irq_ns = 0;
+        key.key_descs[i].dev = &key;
         key.key_descs[i].timer.function = key_timer_handler;
         key.key_descs[i].timer.data = (unsigned long)&key.key_descs[i];
     }
@@ -300,6 +479,18 @@ static int __init key_init(void)
         gpio_set_value(key.key_descs[i].gpio, 0);
     }
 
+    // dedicated workqueue, its workers run at nice -20
+    if(key.defer_mode == KEY_DEFER_HIGHPRI)
+    {
+        key.workqueue = alloc_workqueue(NAME, WQ_HIGHPRI, 0);
+        if(!key.workqueue)
+        {
+            printk(NAME " alloc_workqueue failed\n");
+            i = 0;  // no irq requested yet
+            goto err_irq_request;
+        }
+    }
+
     // irq
     for(i=0;i<KEY_COUNT;i++)
     {
@@ -316,10 +507,12 @@ static int __init key_init(void)
 
         // key.key_descs[i].irq_num = gpio_to_irq(key.key_descs[i].gpio);
 
-        // request irq
-        rc = request_irq(key.key_descs[i].irq_num, 
+        // request irq, the thread is only created in thread mode
+        rc = request_threaded_irq(key.key_descs[i].irq_num, 
                         key_irq_handler, 
-                        irq_get_trigger_type(key.key_descs[i].irq_num), 
+                        key.defer_mode == KEY_DEFER_THREAD ? key_irq_thread : NULL,
+                        irq_get_trigger_type(key.key_descs[i].irq_num) |
+                        (key.defer_mode == KEY_DEFER_THREAD ? IRQF_ONESHOT : 0), 
                         key.key_descs[i].name, 
                         &key.key_descs[i]);
         if(rc)
@@ -330,9 +523,6 @@ static int __init key_init(void)
 
         // init tasklet
         // tasklet_init(&key.key_descs[i].tasklet, key_tasklet_handler, (unsigned long)&key.key_descs[i]);
-
-        // init work
-        INIT_WORK(&key.key_descs[i].work, key_work_handler);
     }
 
     // device id
@@ -412,12 +602,18 @@ err_gpio_request:
 err_find_node:
     // No resources allocated yet, just return error
 
-    // free timer
+    // free work and timer, the work re-arms the timer so it goes first
     for(i=0;i<KEY_COUNT;i++)
     {
+        flush_work(&key.key_descs[i].work);
         del_timer_sync(&key.key_descs[i].timer);
     }
 
+    if(key.workqueue)
+    {
+        destroy_workqueue(key.workqueue);
+    }
+
     return -ENODEV;
 }
 
@@ -446,13 +642,18 @@ static void __exit key_exit(void)
         }
     }
 
-    // free timer and work
+    // free work and timer, the work re-arms the timer so it goes first
     for(i=0;i<KEY_COUNT;i++)
     {
-        del_timer_sync(&key.key_descs[i].timer);
         flush_work(&key.key_descs[i].work);
+        del_timer_sync(&key.key_descs[i].timer);
         // If using tasklets, add: tasklet_kill(&key.key_descs[i].tasklet);
     }
+
+    if(key.workqueue)
+    {
+        destroy_workqueue(key.workqueue);
+    }
 }
 
 module_init(key_init);
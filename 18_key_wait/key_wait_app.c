@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "key_event.h"
+
 /*
 *
 * This is a sample user application to demonstrate the usage of the
@@ -37,7 +39,8 @@ int main(int argc, char *argv[])
     if(cmd == 1)
     {
         int ret = 0;
-        int key_val[2];
+        int i;
+        struct key_event key_val[16];
 
         while(1)
         {
@@ -53,7 +56,12 @@ int main(int argc, char *argv[])
             }
             else
             {
-                printf("key[%d]val = %d\n", key_val[0], key_val[1]);
+                for(i = 0; i < ret / (int)sizeof key_val[0]; i++)
+                {
+                    printf("key[%u]val = %d @ %llu.%06llu\n", key_val[i].id, key_val[i].value,
+                           (unsigned long long)key_val[i].time_ns / 1000000000ULL,
+                           (unsigned long long)key_val[i].time_ns % 1000000000ULL / 1000);
+                }
             }
         }
     }
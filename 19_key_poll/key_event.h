@@ -0,0 +1,16 @@
+#ifndef _KEY_EVENT_H
+#define _KEY_EVENT_H
+
+#include <linux/types.h>
+
+/*
+ * One debounced key transition, as returned by read().
+ * read() returns as many whole events as fit in the user buffer.
+ */
+struct key_event {
+    __u32 id;       // key index
+    __s32 value;    // 0: pressed; 1: not pressed
+    __u64 time_ns;  // CLOCK_MONOTONIC timestamp of the debounced edge
+};
+
+#endif // _KEY_EVENT_H
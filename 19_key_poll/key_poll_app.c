@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "key_event.h"
+
 
 #define USE_POLL   1
 #define USE_SELECT 0
@@ -57,7 +59,8 @@ int main(int argc, char *argv[])
     if(cmd == 1)
     {
         int ret = 0;
-        int key_val[2];
+        int i;
+        struct key_event key_val[16];
 
         while(1)
         {
@@ -82,7 +85,12 @@ int main(int argc, char *argv[])
                 }
                 else
                 {
-                    printf("key[%d]val = %d\n", key_val[0], key_val[1]);
+                    for(i = 0; i < ret / (int)sizeof key_val[0]; i++)
+                    {
+                        printf("key[%u]val = %d @ %llu.%06llu\n", key_val[i].id, key_val[i].value,
+                               (unsigned long long)key_val[i].time_ns / 1000000000ULL,
+                               (unsigned long long)key_val[i].time_ns % 1000000000ULL / 1000);
+                    }
                 }
             }
             else if(ret == 0)
@@ -115,7 +123,12 @@ int main(int argc, char *argv[])
                     }
                     else
                     {
-                        printf("key[%d]val = %d\n", key_val[0], key_val[1]);
+                        for(i = 0; i < ret / (int)sizeof key_val[0]; i++)
+                        {
+                            printf("key[%u]val = %d @ %llu.%06llu\n", key_val[i].id, key_val[i].value,
+                                   (unsigned long long)key_val[i].time_ns / 1000000000ULL,
+                                   (unsigned long long)key_val[i].time_ns % 1000000000ULL / 1000);
+                        }
                     }
                 }
             }
@@ -7,6 +7,8 @@
 #include <linux/types.h>  // size_t
 #include <linux/errno.h> // -EFAULT
 
+#include "drv_debug.h"
+
 #define NAME "char_dev_base"
 #define CHAR_DEV_BASE_MAJOR 100
 
@@ -20,12 +22,12 @@ char write_buf[100];
 
 int char_dev_base_open (struct inode *inode, struct file *filp)
 {
-    printk(NAME " open\n");
+    DRV_DBG(NAME " open\n");
     return 0;
 }
 int char_dev_base_release (struct inode *inode, struct file *filp)
 {
-    printk(NAME " release\n");
+    DRV_DBG(NAME " release\n");
     return 0;
 }
 ssize_t char_dev_base_read (struct file *filp, char __user *buf, size_t count, loff_t *ppos)
@@ -35,30 +37,30 @@ ssize_t char_dev_base_read (struct file *filp, char __user *buf, size_t count, l
     int copy_len = count < data_len ? count : data_len;
     // int copy_len = min(count, data_len);
     
-    printk(NAME " read\n");
+    DRV_DBG(NAME " read\n");
 
     ret = copy_to_user(buf, char_dev_base_data, copy_len); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_to_user failed, %d bytes not copied\n", ret);
+        DRV_DBG(NAME " copy_to_user failed, %d bytes not copied\n", ret);
         return -EFAULT;
     }
     
-    printk(NAME " read %d bytes successfully\n", copy_len);
+    DRV_DBG(NAME " read %d bytes successfully\n", copy_len);
     return copy_len;  // 返回实际读取的字节数
 }
 ssize_t char_dev_base_write (struct file *filp, const char __user *buf, size_t count, loff_t *ppos)
 {
     int ret = 0;
-    printk(NAME " write %d\n", count);
+    DRV_DBG(NAME " write %d\n", count);
 
     ret = copy_from_user(write_buf, buf, count); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_from_user failed %d\n", ret);
+        DRV_DBG(NAME " copy_from_user failed %d\n", ret);
         return -EFAULT;
     }
 
     write_buf[count] = '\0'; // null terminate the string
-    printk(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
+    DRV_DBG(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
 
     return count;
 }
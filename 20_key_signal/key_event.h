@@ -0,0 +1,66 @@
+#ifndef _KEY_EVENT_H
+#define _KEY_EVENT_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * One debounced key transition, as returned by read().
+ * read() returns as many whole events as fit in the user buffer.
+ */
+struct key_event {
+    __u32 id;       // key index, chord index for KEY_EV_CHORD
+    __s32 value;    // enum key_event_value
+    __u64 time_ns;  // CLOCK_MONOTONIC timestamp of the debounced edge
+};
+
+enum key_event_value {
+    KEY_EV_PRESS = 0,
+    KEY_EV_RELEASE = 1,
+    // gestures, see KEY_SET_GESTURE
+    KEY_EV_CLICK = 2,
+    KEY_EV_DOUBLE_CLICK = 3,
+    KEY_EV_LONG_PRESS = 4,
+    KEY_EV_REPEAT = 5,      // every repeat_ms while held after a long press
+    KEY_EV_CHORD = 6,
+};
+
+#define KEY_IOCTL_MAGIC 'k'
+/*
+ * Also queue realtime signal *arg (SIGRTMIN..SIGRTMAX, 0: off) to the
+ * calling process whenever the event fifo stops being empty. si_int holds
+ * the number of queued events. Like SIGIO it is sent once per burst; read
+ * until -EAGAIN to re-arm it.
+ */
+#define KEY_SET_RTSIG   _IOW(KEY_IOCTL_MAGIC, 0, int)
+
+/*
+ * Gesture recognizer. With KEY_GESTURE_ENABLE set, read() returns gesture
+ * events instead of press/release (both with KEY_GESTURE_RAW). A zero time
+ * turns that gesture off; without double_click_ms a click is reported at
+ * release, with it only once the window has expired.
+ */
+#define KEY_GESTURE_ENABLE  (1 << 0)
+#define KEY_GESTURE_RAW     (1 << 1)
+
+struct key_gesture_cfg {
+    __u32 flags;            // KEY_GESTURE_*
+    __u32 long_press_ms;
+    __u32 repeat_ms;
+    __u32 double_click_ms;
+};
+
+// a chord fires when its last key goes down while the others are held
+#define KEY_MAX_CHORDS  8
+
+struct key_chord {
+    __u32 index;    // 0 .. KEY_MAX_CHORDS - 1, reported as key_event.id
+    __u32 reserved;
+    __u64 mask;     // bit n: key n; 0 removes the chord
+};
+
+#define KEY_SET_GESTURE _IOW(KEY_IOCTL_MAGIC, 1, struct key_gesture_cfg)
+#define KEY_GET_GESTURE _IOR(KEY_IOCTL_MAGIC, 2, struct key_gesture_cfg)
+#define KEY_SET_CHORD   _IOW(KEY_IOCTL_MAGIC, 3, struct key_chord)
+
+#endif // _KEY_EVENT_H
@@ -28,30 +28,72 @@
 #include <linux/irq.h>
 #include <linux/wait.h>
 #include <linux/sched.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
 #include <linux/poll.h>
 #include <linux/signal.h>
+#include <linux/ioctl.h>
+#include <linux/pid.h>
+#include <linux/delay.h>  // udelay
+#include <linux/hrtimer.h>
+#include <linux/bitmap.h>
+
+#include "key_event.h"
+#include "drv_debug.h"
 
 
 #define NAME "key_signal"
 #define CHAR_DEV_BASE_MAJOR 100
 
-#define KEY_COUNT   1
+#define KEY_DEV_COUNT   1
 #define KEY_NODE_PATH   "/key"
 
-#define KEY_DEBOUNCE_TIME_MS 10
+/*
+ * The /key node describes the keys in one of two ways:
+ *
+ *   key-gpios = <...>, <...>;  one gpio (and "interrupts" entry) per key,
+ *                              key id = index
+ *
+ *   row-gpios = <...>, <...>;  key matrix: rows are pulled-up inputs with
+ *   col-gpios = <...>, <...>;  falling-edge irqs, columns are driven low
+ *                              one at a time, key id = row * cols + col
+ *
+ * Either way one shared hrtimer samples every key into a bitmap and
+ * debounces them together, see key_debounce().
+ */
+#define KEY_MAX_COUNT   64
+
+#define KEY_SCAN_PERIOD_MIN_US  100
+#define KEY_HOLD_SCAN_MS     20     // matrix: release check while keys are held
+#define KEY_MATRIX_SETTLE_US 5      // column drive to row sample delay
+
+#define KEY_EVENT_FIFO_SIZE 64  // events, power of 2
+
+// per-key gesture states, see key_gesture_input()
+enum key_gesture_state {
+    KEY_GS_IDLE,
+    KEY_GS_DOWN,        // pressed, waiting for release or long press
+    KEY_GS_HELD,        // long press reported, repeating if configured
+    KEY_GS_UP,          // short press released, waiting for a second one
+    KEY_GS_DOWN2,       // second press inside the double-click window
+    KEY_GS_CHORD,       // part of a reported chord, swallowed until release
+};
 
 struct key_desc{
-    int gpio;
+    int gpio;           // -1 for matrix keys, they have no line of their own
     int irq_num;
     // unsigned int key_value;
 
-    atomic_t key_state; // 0: pressed; 1: not pressed
-    atomic_t key_read_flag; // 0: no update; 1: update
+    unsigned int id;    // index in key_descs, reported as key_event.id
+    unsigned int integrator;    // 0: settled released ... steps: settled pressed
 
     unsigned char name[32];
     irqreturn_t (*irq_handler)(int, void *);
 
-    struct timer_list timer;    // timer for key debounce
+    enum key_gesture_state gstate;
+    unsigned long gdeadline;    // jiffies, valid in DOWN, HELD (repeat) and UP
 };
 
 struct key_dev{
@@ -62,15 +104,59 @@ struct key_dev{
     struct device *key_device;  // device
     struct device_node *np;     // device node
 
-    struct key_desc key_descs[KEY_COUNT];
+    struct key_desc *key_descs; // reported keys, sized from the device tree
+    unsigned int key_count;
+
+    // matrix lines, row_count is 0 when every key has its own gpio
+    struct key_desc *rows;
+    struct key_desc *cols;
+    unsigned int row_count;
+    unsigned int col_count;
+
+    // debounce engine, bit n of each bitmap is key n
+    struct hrtimer scan_timer;  // one sampling timer for all keys
+    atomic_t running;           // scan_timer armed; matrix: row irqs are off
+    ktime_t period;             // scan_period_us latched at engine start
+    unsigned int steps;         // integrator ceiling, debounce_us / period
+    DECLARE_BITMAP(sampled, KEY_MAX_COUNT);  // 1: low level at the last scan
+    DECLARE_BITMAP(pressed, KEY_MAX_COUNT);  // 1: debounced pressed
     wait_queue_head_t wq;       // wait queue head
 
+    // debounced transitions and gestures, drained by read(); both scan_timer
+    // and gesture_timer queue events, so producers still need the lock
+    DECLARE_KFIFO(events, struct key_event, KEY_EVENT_FIFO_SIZE);
+    spinlock_t fifo_lock;       // serializes producers and dropped
+    struct mutex read_lock;     // serializes consumers (readers)
+    unsigned int dropped;       // events lost because the fifo was full
+
     struct fasync_struct *fasync; // asynchronous notification
 
+    // one notification per burst: set when a reader empties the fifo,
+    // taken by whoever next sees it non-empty
+    atomic_t notify_armed;
+
+    // optional queued realtime signal carrying the fifo depth
+    spinlock_t rtsig_lock;
+    struct pid *rtsig_pid;      // thread group to signal, NULL: off
+    struct file *rtsig_filp;    // file that subscribed, cleared on release
+    int rtsig;
+
+    // gesture recognizer, replaces press/release events when enabled
+    spinlock_t gesture_lock;    // engine hrtimer vs. gesture timer vs. ioctl
+    struct key_gesture_cfg gesture;
+    DECLARE_BITMAP(chords[KEY_MAX_CHORDS], KEY_MAX_COUNT);
+    struct timer_list gesture_timer;    // earliest per-key deadline
 };
 
 struct key_dev key;
 
+static unsigned int debounce_us = 10000;
+module_param(debounce_us, uint, 0644);
+MODULE_PARM_DESC(debounce_us, "Time a key level must hold before it is reported (us)");
+
+static unsigned int scan_period_us = 1000;
+module_param(scan_period_us, uint, 0644);
+MODULE_PARM_DESC(scan_period_us, "Key sampling period while any key is unsettled (us)");
 
 static int key_fasync(int fd, struct file *filp, int on)
 {
@@ -79,11 +165,40 @@ static int key_fasync(int fd, struct file *filp, int on)
     return fasync_helper(fd, filp, on, &dev->fasync);
 }
 
+// subscribe filp's process to sig (SIGRTMIN..SIGRTMAX), 0 unsubscribes
+static int key_set_rtsig(struct key_dev *dev, struct file *filp, int sig)
+{
+    struct pid *old;
+    unsigned long flags;
+
+    if(sig && (sig < SIGRTMIN || sig > SIGRTMAX))
+    {
+        return -EINVAL;
+    }
+
+    spin_lock_irqsave(&dev->rtsig_lock, flags);
+    // a file can only drop its own subscription
+    if(!sig && dev->rtsig_filp != filp)
+    {
+        spin_unlock_irqrestore(&dev->rtsig_lock, flags);
+        return 0;
+    }
+    old = dev->rtsig_pid;
+    dev->rtsig_pid = sig ? get_pid(task_tgid(current)) : NULL;
+    dev->rtsig_filp = sig ? filp : NULL;
+    dev->rtsig = sig;
+    spin_unlock_irqrestore(&dev->rtsig_lock, flags);
+
+    put_pid(old);
+
+    return 0;
+}
+
 
 /* The various file operations we support. */
 int key_open (struct inode *inode, struct file *filp)
 {
-    printk(NAME " open\n");
+    DRV_DBG(NAME " open\n");
     filp->private_data = &key;
 
     return 0;
@@ -91,10 +206,11 @@ int key_open (struct inode *inode, struct file *filp)
 
 int key_release (struct inode *inode, struct file *filp)
 {
-    printk(NAME " release\n");
+    DRV_DBG(NAME " release\n");
     
     // free asynchronous notification before clearing private_data
     key_fasync(-1, filp, 0);
+    key_set_rtsig(&key, filp, 0);
     
     filp->private_data = NULL;
 
@@ -103,73 +219,379 @@ int key_release (struct inode *inode, struct file *filp)
 
 static int is_any_key_pressed(struct key_dev *dev)
 {
-    int i;
-    for(i=0;i<KEY_COUNT;i++)
+    return !kfifo_is_empty(&dev->events);
+}
+
+// SIGIO to fasync owners, plus the realtime signal with si_int = depth
+static void key_notify(struct key_dev *dev)
+{
+    struct task_struct *task;
+    struct siginfo info;
+    unsigned long flags;
+
+    // send signal for fasync
+    kill_fasync(&dev->fasync, SIGIO, POLL_IN);
+
+    spin_lock_irqsave(&dev->rtsig_lock, flags);
+    if(dev->rtsig_pid)
     {
-        if(atomic_read(&dev->key_descs[i].key_read_flag) == 1)
+        memset(&info, 0, sizeof(info));
+        info.si_signo = dev->rtsig;
+        info.si_code = SI_QUEUE;
+        info.si_int = kfifo_len(&dev->events);
+
+        rcu_read_lock();
+        task = pid_task(dev->rtsig_pid, PIDTYPE_PID);
+        if(task)
         {
-            return 1;
+            send_sig_info(dev->rtsig, &info, task);
         }
+        rcu_read_unlock();
     }
+    spin_unlock_irqrestore(&dev->rtsig_lock, flags);
+}
 
-    return 0;
+// notify only if nobody has since the fifo was last drained
+static void key_notify_once(struct key_dev *dev)
+{
+    if(atomic_xchg(&dev->notify_armed, 0))
+    {
+        key_notify(dev);
+    }
 }
 
-ssize_t key_read (struct file *filp, char __user *buf, size_t count, loff_t *ppos)
+// queue one event, return 1 if it made it into the fifo
+static int key_queue(struct key_dev *dev, unsigned int id, int value)
 {
-    int ret = 0;
-    int data_len = 0;
-    int copy_len = 0;
-    int gpio_val[2]; //[0] - key id, [1] - key value
+    struct key_event ev;
+    unsigned long flags;
+    unsigned int dropped = 0;
+
+    ev.id = id;
+    ev.value = value;
+    ev.time_ns = ktime_get_ns();
+
+    spin_lock_irqsave(&dev->fifo_lock, flags);
+    if(!kfifo_in(&dev->events, &ev, 1))
+    {
+        dropped = ++dev->dropped;
+    }
+    spin_unlock_irqrestore(&dev->fifo_lock, flags);
+
+    if(dropped)
+    {
+        printk_ratelimited(KERN_WARNING NAME " event fifo full, %u events dropped\n", dropped);
+        return 0;
+    }
+
+    return 1;
+}
+
+static void key_wake(struct key_dev *dev)
+{
+    // wake up blocked readers and poll/select/epoll waiters
+    wake_up_interruptible(&dev->wq);
+
+    // one signal per burst, readers drain the fifo until -EAGAIN
+    key_notify_once(dev);
+}
+
+// does the key wait for its gdeadline? a zero time turns that step off
+static int key_gesture_pending(struct key_dev *dev, struct key_desc *key_desc)
+{
+    switch(key_desc->gstate)
+    {
+        case KEY_GS_DOWN:
+            return dev->gesture.long_press_ms != 0;
+        case KEY_GS_HELD:
+            return dev->gesture.repeat_ms != 0;
+        case KEY_GS_UP:
+            return 1;
+        default:
+            return 0;
+    }
+}
 
+// re-arm the gesture timer for the earliest pending deadline
+static void key_gesture_arm(struct key_dev *dev)
+{
+    struct key_desc *key_desc;
+    unsigned long next = 0;
+    int pending = 0;
     int i;
 
-    struct key_dev *dev = (struct key_dev *)filp->private_data;
+    for(i=0;i<dev->key_count;i++)
+    {
+        key_desc = &dev->key_descs[i];
+        if(!key_gesture_pending(dev, key_desc))
+        {
+            continue;
+        }
+        if(!pending || time_before(key_desc->gdeadline, next))
+        {
+            next = key_desc->gdeadline;
+        }
+        pending = 1;
+    }
 
-    if(filp->f_flags & O_NONBLOCK)
+    if(pending)
     {
-        if(!is_any_key_pressed(dev))
+        mod_timer(&dev->gesture_timer, next);
+    }
+}
+
+// press completed a configured chord: report it and swallow its keys
+static int key_gesture_chord(struct key_dev *dev, struct key_desc *key_desc)
+{
+    int c, i;
+
+    for(c=0;c<KEY_MAX_CHORDS;c++)
+    {
+        if(!test_bit(key_desc->id, dev->chords[c]) ||
+           !bitmap_subset(dev->chords[c], dev->pressed, dev->key_count))
         {
-            return -EAGAIN;
+            continue;
+        }
+
+        for_each_set_bit(i, dev->chords[c], dev->key_count)
+        {
+            dev->key_descs[i].gstate = KEY_GS_CHORD;
+        }
+        return key_queue(dev, c, KEY_EV_CHORD);
+    }
+
+    return 0;
+}
+
+/*
+ * Feed one debounced transition through the key's state machine:
+ *
+ *   IDLE  --press-->  DOWN  --long_press_ms-->  HELD (LONG_PRESS, REPEAT...)
+ *   DOWN  --release-->  UP  --double_click_ms-->  IDLE (CLICK)
+ *   UP    --press-->  DOWN2  --release-->  IDLE (DOUBLE_CLICK)
+ *
+ * A press that completes a chord reports CHORD instead. Called with
+ * gesture_lock held, returns the number of events queued.
+ */
+static int key_gesture_input(struct key_dev *dev, struct key_desc *key_desc, int value)
+{
+    struct key_gesture_cfg *cfg = &dev->gesture;
+    int queued = 0;
+
+    if(cfg->flags & KEY_GESTURE_RAW)
+    {
+        queued += key_queue(dev, key_desc->id, value);
+    }
+
+    if(value == KEY_EV_PRESS)
+    {
+        queued += key_gesture_chord(dev, key_desc);
+        if(key_desc->gstate == KEY_GS_CHORD)
+        {
+            return queued;
+        }
+
+        if(key_desc->gstate == KEY_GS_UP)
+        {
+            key_desc->gstate = KEY_GS_DOWN2;
+        }
+        else
+        {
+            key_desc->gstate = KEY_GS_DOWN;
+            key_desc->gdeadline = jiffies + msecs_to_jiffies(cfg->long_press_ms);
         }
     }
     else
     {
-        // wait event
-        // wait_event_interruptible(dev->wq, is_any_key_pressed(dev));
+        switch(key_desc->gstate)
+        {
+            case KEY_GS_DOWN:
+                if(cfg->double_click_ms)
+                {
+                    key_desc->gstate = KEY_GS_UP;
+                    key_desc->gdeadline = jiffies + msecs_to_jiffies(cfg->double_click_ms);
+                    break;
+                }
+                queued += key_queue(dev, key_desc->id, KEY_EV_CLICK);
+                key_desc->gstate = KEY_GS_IDLE;
+                break;
+
+            case KEY_GS_DOWN2:
+                queued += key_queue(dev, key_desc->id, KEY_EV_DOUBLE_CLICK);
+                key_desc->gstate = KEY_GS_IDLE;
+                break;
+
+            default:
+                // HELD and CHORD end silently
+                key_desc->gstate = KEY_GS_IDLE;
+                break;
+        }
     }
 
-    // printk(NAME " after wait_event\n");
-    
-    for(i=0;i<KEY_COUNT;i++)
+    key_gesture_arm(dev);
+
+    return queued;
+}
+
+// gesture timer: fire long presses, repeats and expired click windows
+static void key_gesture_timer(unsigned long data)
+{
+    struct key_dev *dev = (struct key_dev *)data;
+    struct key_gesture_cfg *cfg = &dev->gesture;
+    struct key_desc *key_desc;
+    unsigned long flags;
+    int queued = 0;
+    int i;
+
+    spin_lock_irqsave(&dev->gesture_lock, flags);
+    for(i=0;i<dev->key_count;i++)
     {
-        if(atomic_read(&dev->key_descs[i].key_read_flag) == 1)
+        key_desc = &dev->key_descs[i];
+        if(!key_gesture_pending(dev, key_desc) || time_before(jiffies, key_desc->gdeadline))
         {
-            gpio_val[0] = i;
-            gpio_val[1] = atomic_read(&dev->key_descs[i].key_state);
-            atomic_set(&dev->key_descs[i].key_read_flag, 0);
+            continue;
+        }
 
-            break;
+        switch(key_desc->gstate)
+        {
+            case KEY_GS_DOWN:
+                queued += key_queue(dev, key_desc->id, KEY_EV_LONG_PRESS);
+                key_desc->gstate = KEY_GS_HELD;
+                key_desc->gdeadline = jiffies + msecs_to_jiffies(cfg->repeat_ms);
+                break;
+
+            case KEY_GS_HELD:
+                queued += key_queue(dev, key_desc->id, KEY_EV_REPEAT);
+                key_desc->gdeadline += msecs_to_jiffies(cfg->repeat_ms);
+                break;
+
+            case KEY_GS_UP:
+                queued += key_queue(dev, key_desc->id, KEY_EV_CLICK);
+                key_desc->gstate = KEY_GS_IDLE;
+                break;
+
+            default:
+                break;
         }
     }
+    key_gesture_arm(dev);
+    spin_unlock_irqrestore(&dev->gesture_lock, flags);
 
-    if(i == KEY_COUNT)
+    if(queued)
     {
-        return 0;
+        key_wake(dev);
     }
+}
 
-    data_len = sizeof(gpio_val);
-    copy_len = count < data_len ? count : data_len;
+// apply a new gesture configuration, in-flight gestures are dropped
+static int key_set_gesture(struct key_dev *dev, const struct key_gesture_cfg *cfg)
+{
+    unsigned long flags;
+    int i;
 
-    ret = copy_to_user(buf, &gpio_val, copy_len); // ret fail bytes
-    if(ret != 0) {
-        printk(NAME " copy_to_user failed, %d bytes not copied\n", ret);
-        return -EFAULT;
+    if(cfg->flags & ~(KEY_GESTURE_ENABLE | KEY_GESTURE_RAW))
+    {
+        return -EINVAL;
+    }
+
+    del_timer_sync(&dev->gesture_timer);
+
+    spin_lock_irqsave(&dev->gesture_lock, flags);
+    dev->gesture = *cfg;
+    for(i=0;i<dev->key_count;i++)
+    {
+        dev->key_descs[i].gstate = KEY_GS_IDLE;
+    }
+    spin_unlock_irqrestore(&dev->gesture_lock, flags);
+
+    return 0;
+}
+
+static int key_set_chord(struct key_dev *dev, const struct key_chord *chord)
+{
+    unsigned long flags;
+    int i;
+
+    if(chord->index >= KEY_MAX_CHORDS ||
+       (dev->key_count < 64 && (chord->mask >> dev->key_count)))
+    {
+        return -EINVAL;
     }
-    
-    // printk(NAME " read %d bytes successfully\n", copy_len);
 
-    return copy_len;  // 返回实际读取的字节数
+    spin_lock_irqsave(&dev->gesture_lock, flags);
+    bitmap_zero(dev->chords[chord->index], KEY_MAX_COUNT);
+    for(i=0;i<dev->key_count;i++)
+    {
+        if(chord->mask & (1ULL << i))
+        {
+            __set_bit(i, dev->chords[chord->index]);
+        }
+    }
+    spin_unlock_irqrestore(&dev->gesture_lock, flags);
+
+    return 0;
+}
+
+ssize_t key_read (struct file *filp, char __user *buf, size_t count, loff_t *ppos)
+{
+    int ret = 0;
+    unsigned int copied = 0;
+    size_t len = count - count % sizeof(struct key_event);
+
+    struct key_dev *dev = (struct key_dev *)filp->private_data;
+
+    if(len == 0)
+    {
+        return -EINVAL;
+    }
+
+    if(mutex_lock_interruptible(&dev->read_lock))
+    {
+        return -ERESTARTSYS;
+    }
+
+    // another reader may drain the fifo between the wakeup and the lock
+    while(!is_any_key_pressed(dev))
+    {
+        mutex_unlock(&dev->read_lock);
+
+        if(filp->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+
+        // wait event, the condition is re-checked after every wakeup
+        if(wait_event_interruptible(dev->wq, is_any_key_pressed(dev)))
+        {
+            return -ERESTARTSYS;
+        }
+
+        if(mutex_lock_interruptible(&dev->read_lock))
+        {
+            return -ERESTARTSYS;
+        }
+    }
+
+    // return as many whole events as fit in the user buffer
+    ret = kfifo_to_user(&dev->events, buf, len, &copied);
+
+    // drained: re-arm, and catch an event queued before the re-arm
+    if(!is_any_key_pressed(dev))
+    {
+        atomic_set(&dev->notify_armed, 1);
+        if(is_any_key_pressed(dev))
+        {
+            key_notify_once(dev);
+        }
+    }
+    mutex_unlock(&dev->read_lock);
+    if(ret)
+    {
+        DRV_DBG(NAME " copy_to_user failed\n");
+        return ret;
+    }
+
+    return copied;  // 返回实际读取的字节数
 }
 
 // key pool function
@@ -182,12 +604,65 @@ static unsigned int key_poll(struct file *filp, struct poll_table_struct *wait)
 
     if(is_any_key_pressed(dev))
     {
-        mask |= POLLIN | POLLPRI;
-    }   
+        mask |= POLLIN | POLLRDNORM;
+    }
 
     return mask;
 }
 
+// key ioctl function
+static long key_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct key_dev *dev = (struct key_dev *)filp->private_data;
+    struct key_gesture_cfg cfg;
+    struct key_chord chord;
+    unsigned long flags;
+    int val;
+
+    switch(cmd)
+    {
+        case KEY_SET_RTSIG:
+            if(copy_from_user(&val, (int __user *)arg, sizeof(val)))
+            {
+                return -EFAULT;
+            }
+            return key_set_rtsig(dev, filp, val);
+
+        case KEY_SET_GESTURE:
+            if(copy_from_user(&cfg, (void __user *)arg, sizeof(cfg)))
+            {
+                return -EFAULT;
+            }
+            return key_set_gesture(dev, &cfg);
+
+        case KEY_GET_GESTURE:
+            // snapshot under the lock, KEY_SET_GESTURE may be rewriting it
+            spin_lock_irqsave(&dev->gesture_lock, flags);
+            cfg = dev->gesture;
+            spin_unlock_irqrestore(&dev->gesture_lock, flags);
+
+            if(copy_to_user((void __user *)arg, &cfg, sizeof(cfg)))
+            {
+                return -EFAULT;
+            }
+            return 0;
+
+        case KEY_SET_CHORD:
+            if(copy_from_user(&chord, (void __user *)arg, sizeof(chord)))
+            {
+                return -EFAULT;
+            }
+            return key_set_chord(dev, &chord);
+
+        case FIONREAD:
+            // bytes ready, always a whole number of events
+            val = kfifo_len(&dev->events) * sizeof(struct key_event);
+            return put_user(val, (int __user *)arg);
+
+        default:
+            return -ENOTTY;
+    }
+}
 
 
 static const struct file_operations key_fops = {
@@ -197,205 +672,599 @@ static const struct file_operations key_fops = {
     .read      = key_read,
     .poll      = key_poll,
     .fasync    = key_fasync,
+    .unlocked_ioctl = key_ioctl,
 };
 
-// timer handler function
-static void key_timer_handler(unsigned long data)
+// queue one debounced transition, or feed it to the gesture recognizer
+static int key_report(struct key_dev *dev, struct key_desc *key_desc, int value)
 {
-    struct key_desc *key_desc = (struct key_desc *)data;
-    struct key_dev *key_dev = container_of(key_desc, struct key_dev, key_descs[0]);
+    int queued;
 
-    if(gpio_get_value(key_desc->gpio) == 0)
+    DRV_DBG(NAME " %s state: %d\n", key_desc->name, value);
+
+    spin_lock(&dev->gesture_lock);
+    if(dev->gesture.flags & KEY_GESTURE_ENABLE)
     {
-        atomic_set(&key_desc->key_state, 0);
+        queued = key_gesture_input(dev, key_desc, value);
     }
     else
     {
-        atomic_set(&key_desc->key_state, 1);
+        queued = key_queue(dev, key_desc->id, value);
     }
+    spin_unlock(&dev->gesture_lock);
 
-    atomic_set(&key_desc->key_read_flag, 1);
-
-    // wake up wait queue for poll/select
-    wake_up_interruptible(&key_dev->wq);
+    return queued;
+}
 
-    // send signal for fasync
-    kill_fasync(&key_dev->fasync, SIGIO, POLL_IN);
+// sample every key that has its own gpio into the sampled bitmap
+static void key_sample_direct(struct key_dev *dev)
+{
+    int i;
 
-    printk(NAME " timer handler, %s state: %d\n", key_desc->name, atomic_read(&key_desc->key_state));
+    for(i=0;i<dev->key_count;i++)
+    {
+        if(gpio_get_value(dev->key_descs[i].gpio))
+        {
+            __clear_bit(i, dev->sampled);
+        }
+        else
+        {
+            __set_bit(i, dev->sampled);
+        }
+    }
 }
 
-
-// irq handler - key_irq_handler
-static irqreturn_t key_irq_handler(int irq, void *key_desc)
+// drive one column at a time and sample the rows into the sampled bitmap
+static void key_sample_matrix(struct key_dev *dev)
 {
-    struct key_desc *key = (struct key_desc *)key_desc;
+    int r, c;
+    int n;
 
-    // start timer
-    mod_timer(&key->timer, jiffies + msecs_to_jiffies(KEY_DEBOUNCE_TIME_MS));
-    // printk(NAME " %s irq, start timer\n", key->name);
+    // idle leaves every column low, float them all so only one is driven at a time
+    for(c=0;c<dev->col_count;c++)
+    {
+        gpio_direction_input(dev->cols[c].gpio);
+    }
 
-    return IRQ_HANDLED;
-}
+    for(c=0;c<dev->col_count;c++)
+    {
+        gpio_direction_output(dev->cols[c].gpio, 0);
+        udelay(KEY_MATRIX_SETTLE_US);
 
+        for(r=0;r<dev->row_count;r++)
+        {
+            n = r * dev->col_count + c;
+            if(gpio_get_value(dev->rows[r].gpio))
+            {
+                __clear_bit(n, dev->sampled);
+            }
+            else
+            {
+                __set_bit(n, dev->sampled);
+            }
+        }
 
+        // float the column again so it cannot fight the next one
+        gpio_direction_input(dev->cols[c].gpio);
+    }
+}
 
-static int __init key_signal_init(void)
+/*
+ * Move every integrator one step toward its sampled level. A key is
+ * reported pressed when its integrator reaches dev->steps and released
+ * when it falls back to 0, so a bounce only delays the report.
+ * Returns the number of reports, *busy is set while any key is unsettled.
+ */
+static int key_debounce(struct key_dev *dev, int *busy)
 {
-    int rc;
-    const char *str;
-    struct device_node *child;
+    struct key_desc *key_desc;
+    int changed = 0;
     int i;
-    int j;
 
-	// printk(KERN_DEBUG NAME " initializing\n");
-	printk(NAME " initializing\n");
+    *busy = 0;
+    for(i=0;i<dev->key_count;i++)
+    {
+        key_desc = &dev->key_descs[i];
 
-    // init atomic_t for each key
-    for(i=0;i<KEY_COUNT;i++)
+        // debounce_us may have shrunk since this key settled
+        if(key_desc->integrator > dev->steps)
+        {
+            key_desc->integrator = dev->steps;
+        }
+
+        if(test_bit(i, dev->sampled))
+        {
+            if(key_desc->integrator < dev->steps)
+            {
+                key_desc->integrator++;
+            }
+        }
+        else if(key_desc->integrator > 0)
+        {
+            key_desc->integrator--;
+        }
+
+        if(key_desc->integrator == dev->steps && !test_bit(i, dev->pressed))
+        {
+            __set_bit(i, dev->pressed);
+            changed += key_report(dev, key_desc, 0);
+        }
+        else if(key_desc->integrator == 0 && test_bit(i, dev->pressed))
+        {
+            __clear_bit(i, dev->pressed);
+            changed += key_report(dev, key_desc, 1);
+        }
+
+        if(key_desc->integrator != 0 && key_desc->integrator != dev->steps)
+        {
+            *busy = 1;
+        }
+    }
+
+    return changed;
+}
+
+// arm the matrix for the next press: all columns low, row irqs on
+static void key_matrix_idle(struct key_dev *dev)
+{
+    int i;
+
+    for(i=0;i<dev->col_count;i++)
     {
-        atomic_set(&key.key_descs[i].key_state, 1);
-        atomic_set(&key.key_descs[i].key_read_flag, 0);
+        gpio_direction_output(dev->cols[i].gpio, 0);
     }
 
-    // init timer
-    for(i=0;i<KEY_COUNT;i++)
+    // an edge seen while the rows were masked is replayed by enable_irq
+    atomic_set(&dev->running, 0);
+    for(i=0;i<dev->row_count;i++)
     {
-        init_timer(&key.key_descs[i].timer);
-        key.key_descs[i].timer.function = key_timer_handler;
-        key.key_descs[i].timer.data = (unsigned long)&key.key_descs[i];
+        enable_irq(dev->rows[i].irq_num);
     }
+}
 
-    // init wait queue head
-    init_waitqueue_head(&key.wq);
+// latch the tunables and start sampling, called with dev->running just set
+static void key_engine_start(struct key_dev *dev)
+{
+    unsigned int period_us = max_t(unsigned int, scan_period_us, KEY_SCAN_PERIOD_MIN_US);
 
-    // find node
-    key.np = of_find_node_by_path(KEY_NODE_PATH);
-    if (!key.np)
+    dev->steps = max_t(unsigned int, DIV_ROUND_UP(debounce_us, period_us), 1);
+    dev->period = ns_to_ktime((u64)period_us * NSEC_PER_USEC);
+
+    hrtimer_start(&dev->scan_timer, dev->period, HRTIMER_MODE_REL);
+}
+
+// shared scan timer: one tick samples and debounces every key
+static enum hrtimer_restart key_timer_handler(struct hrtimer *timer)
+{
+    struct key_dev *key_dev = container_of(timer, struct key_dev, scan_timer);
+    int changed;
+    int busy;
+
+    if(key_dev->row_count)
     {
-        printk(NAME "node not found\n");
-        goto err_find_node;
+        key_sample_matrix(key_dev);
+    }
+    else
+    {
+        key_sample_direct(key_dev);
     }
 
-    // compatible
-    if(of_property_read_string(key.np, "compatible", &str))
+    changed = key_debounce(key_dev, &busy);
+    if(changed)
     {
-        printk(NAME " compatible property read failed\n");
-        return -ENODEV;
+        key_wake(key_dev);
     }
-    printk(NAME " compatible: %s\n", str);
 
-    // status
-    if(of_property_read_string(key.np, "status", &str))
+    if(busy)
     {
-        printk(NAME " status property read failed\n");
-        return -ENODEV;
+        hrtimer_forward_now(timer, key_dev->period);
+        return HRTIMER_RESTART;
     }
-    printk(NAME " status: %s\n", str);
-    
-    
-    // debug: list all child nodes
-    printk(NAME " listing all child nodes:\n");
-    for_each_child_of_node(key.np, child) {
-        printk(NAME " child node: %s\n", child->name);
+
+    if(key_dev->row_count)
+    {
+        // rows cannot signal a release while they are masked, keep polling
+        if(!bitmap_empty(key_dev->pressed, key_dev->key_count))
+        {
+            hrtimer_forward_now(timer, ms_to_ktime(KEY_HOLD_SCAN_MS));
+            return HRTIMER_RESTART;
+        }
+
+        key_matrix_idle(key_dev);
+        return HRTIMER_NORESTART;
     }
 
+    // settled: go idle, unless an edge slipped in after the last sample
+    atomic_set(&key_dev->running, 0);
+    key_sample_direct(key_dev);
+    if(!bitmap_equal(key_dev->sampled, key_dev->pressed, key_dev->key_count) &&
+       !atomic_xchg(&key_dev->running, 1))
+    {
+        hrtimer_forward_now(timer, key_dev->period);
+        return HRTIMER_RESTART;
+    }
+
+    return HRTIMER_NORESTART;
+}
+
+
+// irq handler - key_irq_handler
+static irqreturn_t key_irq_handler(int irq, void *dev_id)
+{
+    struct key_dev *dev = (struct key_dev *)dev_id;
+    int i;
 
-    // gpio - dts
-    for(i=0;i<KEY_COUNT;i++)
+    // the engine is already sampling and will see this edge
+    if(atomic_xchg(&dev->running, 1))
     {
-        // get key gpio
-        key.key_descs[i].gpio = of_get_named_gpio(key.np, "key-gpios", i);
-        if(key.key_descs[i].gpio < 0)
+        return IRQ_HANDLED;
+    }
+
+    if(dev->row_count)
+    {
+        // scanning the columns would retrigger the rows
+        for(i=0;i<dev->row_count;i++)
         {
-            printk(NAME " key gpio not found, error: %d\n", key.key_descs[i].gpio);
-            goto err_find_node;
+            disable_irq_nosync(dev->rows[i].irq_num);
         }
-        printk(NAME " key gpio: %d\n", key.key_descs[i].gpio);
+    }
+
+    key_engine_start(dev);
+    // printk(NAME " irq %d, start engine\n", irq);
 
-        // check if gpio is valid
-        if(!gpio_is_valid(key.key_descs[i].gpio))
+    return IRQ_HANDLED;
+}
+
+// get, request and set as input count gpios of prop; need_irq also maps irqs
+static int key_request_lines(struct device_node *np, const char *prop,
+                             struct key_desc *descs, int count, int need_irq)
+{
+    int rc;
+    int i;
+
+    for(i=0;i<count;i++)
+    {
+        // get key gpio
+        descs[i].gpio = of_get_named_gpio(np, prop, i);
+        if(!gpio_is_valid(descs[i].gpio))
         {
-            printk(NAME " gpio %d is not valid\n", key.key_descs[i].gpio);
-            goto err_find_node;
+            printk(NAME " %s[%d] not found or invalid, error: %d\n", prop, i, descs[i].gpio);
+            rc = descs[i].gpio < 0 ? descs[i].gpio : -EINVAL;
+            goto err_free;
         }
+        printk(NAME " %s[%d]: %d\n", prop, i, descs[i].gpio);
 
         // set name
-        memset(key.key_descs[i].name, 0, sizeof(key.key_descs[i].name));
-        sprintf(key.key_descs[i].name, "key%d", i);
-    }
+        memset(descs[i].name, 0, sizeof(descs[i].name));
+        snprintf(descs[i].name, sizeof(descs[i].name), "%s-%s%d", NAME, prop, i);
 
-    // gpio - request
-    for(i=0;i<KEY_COUNT;i++)
-    {
         // request gpio
-        rc = gpio_request(key.key_descs[i].gpio, key.key_descs[i].name);
+        rc = gpio_request(descs[i].gpio, descs[i].name);
         if(rc)
         {
             printk(NAME " gpio request failed, error: %d (EBUSY means already in use)\n", rc);
-            goto err_gpio_request;
+            goto err_free;
         }
 
         // set gpio direction
-        if(gpio_direction_input(key.key_descs[i].gpio))
+        rc = gpio_direction_input(descs[i].gpio);
+        if(rc)
         {
             printk(NAME " gpio direction input failed\n");
 
             // release gpio
-            gpio_free(key.key_descs[i].gpio);
-            goto err_gpio_request;
+            gpio_free(descs[i].gpio);
+            goto err_free;
+        }
+
+        if(!need_irq)
+        {
+            continue;
+        }
+
+        // get key irq, fall back to the gpio's own irq if "interrupts" is short
+        descs[i].irq_num = irq_of_parse_and_map(np, i);
+        if(!descs[i].irq_num)
+        {
+            descs[i].irq_num = gpio_to_irq(descs[i].gpio);
+        }
+        if(descs[i].irq_num <= 0)
+        {
+            printk(NAME " no irq for %s[%d]\n", prop, i);
+            gpio_free(descs[i].gpio);
+            rc = -EINVAL;
+            goto err_free;
         }
 
-        // set gpio value
-        gpio_set_value(key.key_descs[i].gpio, 0);
+        // set key irq handler
+        descs[i].irq_handler = key_irq_handler;
     }
 
-    // irq
-    for(i=0;i<KEY_COUNT;i++)
+    return 0;
+
+err_free:
+    // Free all previous GPIOs (i-1 and below)
+    while(--i >= 0)
     {
-        // set key irq handler
-        key.key_descs[i].irq_handler = key_irq_handler;
+        gpio_free(descs[i].gpio);
+    }
 
-        // get key irq
-        key.key_descs[i].irq_num = irq_of_parse_and_map(key.np, i);
-        if(!key.key_descs[i].irq_num)
+    return rc;
+}
+
+static void key_free_lines(struct key_desc *descs, int count)
+{
+    int i;
+
+    for(i=0;i<count;i++)
+    {
+        gpio_free(descs[i].gpio);
+    }
+}
+
+static int key_request_irqs(struct key_dev *dev, struct key_desc *descs, int count)
+{
+    unsigned long flags;
+    int rc;
+    int i;
+
+    for(i=0;i<count;i++)
+    {
+        // matrix rows idle high and fall when a key joins them to a column
+        if(dev->row_count)
         {
-            printk(NAME " irq_of_parse_and_map failed for key %d\n", i);
-            goto err_irq_request;
+            flags = IRQF_TRIGGER_FALLING;
+        }
+        else
+        {
+            flags = irq_get_trigger_type(descs[i].irq_num);
+            if(!flags)
+            {
+                flags = IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING;
+            }
         }
-
-        // key.key_descs[i].irq_num = gpio_to_irq(key.key_descs[i].gpio);
 
         // request irq
-        rc = request_irq(key.key_descs[i].irq_num, 
-                        key_irq_handler, 
-                        irq_get_trigger_type(key.key_descs[i].irq_num), 
-                        key.key_descs[i].name, 
-                        &key.key_descs[i]);
+        rc = request_irq(descs[i].irq_num, descs[i].irq_handler, flags, descs[i].name, dev);
         if(rc)
         {
             printk(NAME " irq request failed, error: %d\n", rc);
-            goto err_irq_request;
+
+            // Free all previous IRQs (i-1 and below)
+            while(--i >= 0)
+            {
+                free_irq(descs[i].irq_num, dev);
+            }
+            return rc;
         }
     }
 
+    return 0;
+}
+
+static void key_free_irqs(struct key_dev *dev, struct key_desc *descs, int count)
+{
+    int i;
+
+    for(i=0;i<count;i++)
+    {
+        free_irq(descs[i].irq_num, dev);
+    }
+}
+
+// size the key table from the device tree and claim its gpios and irqs
+static int key_setup(struct key_dev *dev)
+{
+    struct key_desc *lines;
+    int rows, cols, keys;
+    int line_count;
+    int rc;
+    int i;
+
+    rows = of_gpio_named_count(dev->np, "row-gpios");
+    cols = of_gpio_named_count(dev->np, "col-gpios");
+    if(rows > 0 && cols > 0)
+    {
+        keys = rows * cols;
+    }
+    else
+    {
+        rows = 0;
+        cols = 0;
+        keys = of_gpio_named_count(dev->np, "key-gpios");
+    }
+    if(keys <= 0 || keys > KEY_MAX_COUNT)
+    {
+        printk(NAME " bad key count %d, expected 1..%d\n", keys, KEY_MAX_COUNT);
+        return -EINVAL;
+    }
+    printk(NAME " %d keys, matrix %d x %d\n", keys, rows, cols);
+
+    // keys, then matrix rows and columns, in one allocation
+    dev->key_descs = kcalloc(keys + rows + cols, sizeof(*dev->key_descs), GFP_KERNEL);
+    if(!dev->key_descs)
+    {
+        return -ENOMEM;
+    }
+    dev->key_count = keys;
+    dev->row_count = rows;
+    dev->col_count = cols;
+    dev->rows = dev->key_descs + keys;
+    dev->cols = dev->rows + rows;
+
+    // init state for each key
+    for(i=0;i<keys;i++)
+    {
+        dev->key_descs[i].id = i;
+        dev->key_descs[i].gpio = -1;
+        dev->key_descs[i].integrator = 0;
+        sprintf(dev->key_descs[i].name, "key%d", i);
+    }
+
+    if(rows)
+    {
+        rc = key_request_lines(dev->np, "row-gpios", dev->rows, rows, 1);
+        if(rc)
+        {
+            goto err_free;
+        }
+        rc = key_request_lines(dev->np, "col-gpios", dev->cols, cols, 0);
+        if(rc)
+        {
+            key_free_lines(dev->rows, rows);
+            goto err_free;
+        }
+
+        // idle: all columns low so any press pulls its row down
+        for(i=0;i<cols;i++)
+        {
+            gpio_direction_output(dev->cols[i].gpio, 0);
+        }
+
+        lines = dev->rows;
+        line_count = rows;
+    }
+    else
+    {
+        rc = key_request_lines(dev->np, "key-gpios", dev->key_descs, keys, 1);
+        if(rc)
+        {
+            goto err_free;
+        }
+
+        lines = dev->key_descs;
+        line_count = keys;
+    }
+
+    rc = key_request_irqs(dev, lines, line_count);
+    if(rc)
+    {
+        key_free_lines(dev->cols, cols);
+        key_free_lines(lines, line_count);
+        goto err_free;
+    }
+
+    return 0;
+
+err_free:
+    kfree(dev->key_descs);
+    dev->key_descs = NULL;
+
+    return rc;
+}
+
+static void key_teardown(struct key_dev *dev)
+{
+    struct key_desc *lines = dev->row_count ? dev->rows : dev->key_descs;
+    int line_count = dev->row_count ? dev->row_count : dev->key_count;
+    int i;
+
+    // no new edges can start the engine, then stop it
+    for(i=0;i<line_count;i++)
+    {
+        disable_irq(lines[i].irq_num);
+    }
+    hrtimer_cancel(&dev->scan_timer);
+    del_timer_sync(&dev->gesture_timer);
+
+    key_free_irqs(dev, lines, line_count);
+    key_free_lines(lines, line_count);
+    key_free_lines(dev->cols, dev->col_count);
+
+    kfree(dev->key_descs);
+    dev->key_descs = NULL;
+}
+
+
+
+static int __init key_signal_init(void)
+{
+    int rc;
+    const char *str;
+    struct device_node *child;
+
+	// printk(KERN_DEBUG NAME " initializing\n");
+	printk(NAME " initializing\n");
+
+    // init event fifo
+    INIT_KFIFO(key.events);
+    spin_lock_init(&key.fifo_lock);
+    mutex_init(&key.read_lock);
+
+    // init async notification
+    atomic_set(&key.notify_armed, 1);
+    spin_lock_init(&key.rtsig_lock);
+
+    // init gesture recognizer, off until KEY_SET_GESTURE
+    spin_lock_init(&key.gesture_lock);
+    init_timer(&key.gesture_timer);
+    key.gesture_timer.function = key_gesture_timer;
+    key.gesture_timer.data = (unsigned long)&key;
+
+    // init debounce engine
+    hrtimer_init(&key.scan_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    key.scan_timer.function = key_timer_handler;
+    atomic_set(&key.running, 0);
+
+    // init wait queue head
+    init_waitqueue_head(&key.wq);
+
+    // find node
+    key.np = of_find_node_by_path(KEY_NODE_PATH);
+    if (!key.np)
+    {
+        printk(NAME "node not found\n");
+        goto err_find_node;
+    }
+
+    // compatible
+    if(of_property_read_string(key.np, "compatible", &str))
+    {
+        printk(NAME " compatible property read failed\n");
+        return -ENODEV;
+    }
+    printk(NAME " compatible: %s\n", str);
+
+    // status
+    if(of_property_read_string(key.np, "status", &str))
+    {
+        printk(NAME " status property read failed\n");
+        return -ENODEV;
+    }
+    printk(NAME " status: %s\n", str);
+
+
+    // debug: list all child nodes
+    printk(NAME " listing all child nodes:\n");
+    for_each_child_of_node(key.np, child) {
+        printk(NAME " child node: %s\n", child->name);
+    }
+
+
+    // gpio + irq - dts
+    rc = key_setup(&key);
+    if(rc)
+    {
+        goto err_find_node;
+    }
+
     // device id
     key.major = 0;
     if(key.major)
     {
         key.devid = MKDEV(key.major, 0);
-        rc = register_chrdev_region(key.devid, KEY_COUNT, NAME);
+        rc = register_chrdev_region(key.devid, KEY_DEV_COUNT, NAME);
         if(rc < 0) {
             printk(NAME " register_chrdev_region failed\n");
-            goto err_irq_request;
+            goto err_key_setup;
         }
     }
     else
     {
-        rc = alloc_chrdev_region(&key.devid, 0, KEY_COUNT, NAME);
+        rc = alloc_chrdev_region(&key.devid, 0, KEY_DEV_COUNT, NAME);
         if(rc < 0) {
             printk(NAME " alloc_chrdev_region failed\n");
-            goto err_irq_request;
+            goto err_key_setup;
         }
 
         key.major = MAJOR(key.devid);
@@ -406,7 +1275,7 @@ static int __init key_signal_init(void)
 
     // register chrdev
     cdev_init(&key.cdev, &key_fops);
-    rc = cdev_add(&key.cdev, key.devid, KEY_COUNT);
+    rc = cdev_add(&key.cdev, key.devid, KEY_DEV_COUNT);
     if(rc < 0) {
         printk(NAME " cdev_add failed\n");
         goto err_chrdev;
@@ -433,41 +1302,18 @@ err_class:
 err_cdev:
     cdev_del(&key.cdev);
 err_chrdev:
-    unregister_chrdev_region(key.devid, KEY_COUNT);
-    // Fall through to free all IRQs and GPIOs
-    i = KEY_COUNT; // Set i to cleanup all resources
-
-err_irq_request:
-    // Free all previous IRQs (i-1 and below)
-    for(j = i - 1; j >= 0; j--)
-    {
-        free_irq(key.key_descs[j].irq_num, &key.key_descs[j]);
-    }
-
-    i = KEY_COUNT; // Set i to cleanup all resources
-    
-err_gpio_request:
-    // Free all previous GPIOs (i-1 and below)
-    for(j = i - 1; j >= 0; j--)
-    {
-        gpio_free(key.key_descs[j].gpio);
-    }
-
+    unregister_chrdev_region(key.devid, KEY_DEV_COUNT);
+err_key_setup:
+    // free all IRQs, GPIOs and the timer
+    key_teardown(&key);
 err_find_node:
     // No resources allocated yet, just return error
 
-    // free timer
-    for(i=0;i<KEY_COUNT;i++)
-    {
-        del_timer_sync(&key.key_descs[i].timer);
-    }
-
     return -ENODEV;
 }
 
 static void __exit key_signal_exit(void)
 {
-    int i;
     printk(NAME " exit\n");
 
     // wake up all waiting processes before cleanup
@@ -477,26 +1323,10 @@ static void __exit key_signal_exit(void)
     device_destroy(key.key_class, key.devid);
     class_destroy(key.key_class);
     cdev_del(&key.cdev);
-    unregister_chrdev_region(key.devid, KEY_COUNT);
-
-    // free irq and gpio
-    for(i=0;i<KEY_COUNT;i++)
-    {
-        if(key.key_descs[i].irq_num)
-        {
-            free_irq(key.key_descs[i].irq_num, &key.key_descs[i]);
-        }
-        if(key.key_descs[i].gpio)
-        {
-            gpio_free(key.key_descs[i].gpio);
-        }
-    }
+    unregister_chrdev_region(key.devid, KEY_DEV_COUNT);
 
-    // free timer
-    for(i=0;i<KEY_COUNT;i++)
-    {
-        del_timer_sync(&key.key_descs[i].timer);
-    }
+    // free irq, gpio and timer
+    key_teardown(&key);
 }
 
 module_init(key_signal_init);
@@ -504,4 +1334,4 @@ module_exit(key_signal_exit);
 
 MODULE_AUTHOR("Alvin <yuanye0814@gmail.com>");
 MODULE_DESCRIPTION("key - chardev");
-MODULE_LICENSE("GPL");
\ No newline at end of file
+MODULE_LICENSE("GPL");
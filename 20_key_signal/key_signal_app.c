@@ -4,6 +4,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+
+#include "key_event.h"
 
 
 
@@ -11,6 +14,8 @@
 #define USE_SELECT 0
 
 #define USE_SIGNAL 1
+#define USE_RTSIG  0    // with USE_SIGNAL: SIGRTMIN carrying the queue depth
+#define USE_GESTURE 0   // let the driver report clicks, long presses, chords
 
 
 #if USE_POLL // poll
@@ -23,31 +28,67 @@
 
 #if USE_SIGNAL // signal
 #include <signal.h>
+#include <errno.h>
 #endif // signa
 
 int fd;
 
-#if USE_SIGNAL // signal
-static void sigio_signal_func(int signum)
+static const char *key_event_name(int value)
 {
-    int ret;
-    int key_val[2];
+    static const char *names[] = {
+        "press", "release", "click", "double-click", "long-press", "repeat", "chord",
+    };
 
-    printf("Received SIGIO signal\n");
-    ret = read(fd, &key_val, sizeof key_val);
-    if(ret < 0)
+    if(value < 0 || value >= (int)(sizeof names / sizeof names[0]))
     {
-        printf("Failed to read from device file\n");
+        return "?";
     }
-    else if(ret == 0)
-    {
-        printf("No data available (EOF)\n");
-    }
-    else
+    return names[value];
+}
+
+#if USE_SIGNAL // signal
+// one signal per burst: drain until -EAGAIN so the driver re-arms it
+static void key_drain(void)
+{
+    int ret;
+    int i;
+    struct key_event key_val[16];
+
+    while(1)
     {
-        printf("key[%d]val = %d\n", key_val[0], key_val[1]);
+        ret = read(fd, &key_val, sizeof key_val);
+        if(ret < 0)
+        {
+            if(errno != EAGAIN)
+            {
+                printf("Failed to read from device file\n");
+            }
+            break;
+        }
+
+        for(i = 0; i < ret / (int)sizeof key_val[0]; i++)
+        {
+            printf("key[%u]val = %d (%s) @ %llu.%06llu\n", key_val[i].id, key_val[i].value,
+                   key_event_name(key_val[i].value),
+                   (unsigned long long)key_val[i].time_ns / 1000000000ULL,
+                   (unsigned long long)key_val[i].time_ns % 1000000000ULL / 1000);
+        }
     }
 }
+
+#if USE_RTSIG // realtime signal
+static void rtsig_signal_func(int signum, siginfo_t *info, void *ctx)
+{
+    printf("Received SIGRTMIN, %d events queued\n", info->si_int);
+    key_drain();
+}
+#else
+static void sigio_signal_func(int signum)
+{
+    printf("Received SIGIO signal\n");
+    key_drain();
+}
+#endif // realtime signal
 #endif // signal
 /*
 *
@@ -89,10 +130,28 @@ int main(int argc, char *argv[])
         return -1;
     }
 
+#if USE_GESTURE // gesture
+    {
+        struct key_gesture_cfg cfg = {
+            .flags = KEY_GESTURE_ENABLE,
+            .long_press_ms = 800,
+            .repeat_ms = 200,
+            .double_click_ms = 300,
+        };
+        struct key_chord chord = { .index = 0, .mask = 0x3 };   // key0 + key1
+
+        if(ioctl(fd, KEY_SET_GESTURE, &cfg) < 0 || ioctl(fd, KEY_SET_CHORD, &chord) < 0)
+        {
+            printf("gesture setup failed\n");
+        }
+    }
+#endif // gesture
+
     if(cmd == 1)
     {
         int ret = 0;
-        int key_val[2];
+        int i;
+        struct key_event key_val[16];
 
 #if USE_SELECT // select
         while(1)
@@ -117,7 +176,12 @@ int main(int argc, char *argv[])
                 }
                 else
                 {
-                    printf("key[%d]val = %d\n", key_val[0], key_val[1]);
+                    for(i = 0; i < ret / (int)sizeof key_val[0]; i++)
+                    {
+                        printf("key[%u]val = %d @ %llu.%06llu\n", key_val[i].id, key_val[i].value,
+                               (unsigned long long)key_val[i].time_ns / 1000000000ULL,
+                               (unsigned long long)key_val[i].time_ns % 1000000000ULL / 1000);
+                    }
                 }
             }
             else if(ret == 0)
@@ -153,7 +217,12 @@ int main(int argc, char *argv[])
                     }
                     else
                     {
-                        printf("key[%d]val = %d\n", key_val[0], key_val[1]);
+                        for(i = 0; i < ret / (int)sizeof key_val[0]; i++)
+                        {
+                            printf("key[%u]val = %d @ %llu.%06llu\n", key_val[i].id, key_val[i].value,
+                                   (unsigned long long)key_val[i].time_ns / 1000000000ULL,
+                                   (unsigned long long)key_val[i].time_ns % 1000000000ULL / 1000);
+                        }
                     }
                 }
             }
@@ -171,9 +240,26 @@ int main(int argc, char *argv[])
 
 
 #if USE_SIGNAL // signal
+#if USE_RTSIG // realtime signal
+        struct sigaction sa;
+        int sig = SIGRTMIN;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = rtsig_signal_func;
+        sa.sa_flags = SA_SIGINFO;
+        sigaction(SIGRTMIN, &sa, NULL);
+        if(ioctl(fd, KEY_SET_RTSIG, &sig) < 0)
+        {
+            printf("KEY_SET_RTSIG failed\n");
+        }
+#else
         signal(SIGIO, sigio_signal_func);
         fcntl(fd, F_SETOWN, getpid());
         fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | FASYNC);
+#endif // realtime signal
+
+        // events queued before the handler was installed raise no signal
+        key_drain();
         
         while(1)
         {
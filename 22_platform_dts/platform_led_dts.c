@@ -15,6 +15,8 @@
 #include <linux/of.h> // of_find_node_by_path
 #include <linux/of_gpio.h> // of_get_named_gpio
 
+#include "drv_debug.h"
+
 #define NAME "platform_led_dts"
 
 #define CHAR_DEV_BASE_MAJOR 100
@@ -55,14 +57,14 @@ void led_off(void)
 
 int led_open (struct inode *inode, struct file *filp)
 {
-    printk(NAME " open\n");
+    DRV_DBG(NAME " open\n");
     filp->private_data = &led;
     return 0;
 }
 
 int led_release (struct inode *inode, struct file *filp)
 {
-    printk(NAME " release\n");
+    DRV_DBG(NAME " release\n");
     filp->private_data = NULL;
     return 0;
 }
@@ -74,17 +76,17 @@ ssize_t led_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
     int copy_len = 0;
     int gpio_val;
     
-    printk(NAME " read\n");
+    DRV_DBG(NAME " read\n");
 
     // read led status - use internal state instead of gpio_get_value for output pins
     gpio_val = gpio_get_value(led.led_gpio);
-    printk(NAME " gpio_get_value: %d, led_state: %d\n", gpio_val, led.led_state);
+    DRV_DBG(NAME " gpio_get_value: %d, led_state: %d\n", gpio_val, led.led_state);
     
     if(led.led_state == 1){
-        printk(NAME " led is ON\n");
+        DRV_DBG(NAME " led is ON\n");
         snprintf(read_buf, sizeof(read_buf), "LED is ON\n");
     } else {
-        printk(NAME " led is OFF\n");
+        DRV_DBG(NAME " led is OFF\n");
         snprintf(read_buf, sizeof(read_buf), "LED is OFF\n");
     }
 
@@ -93,37 +95,37 @@ ssize_t led_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
 
     ret = copy_to_user(buf, read_buf, copy_len); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_to_user failed, %d bytes not copied\n", ret);
+        DRV_DBG(NAME " copy_to_user failed, %d bytes not copied\n", ret);
         return -EFAULT;
     }
     
-    printk(NAME " read %d bytes successfully\n", copy_len);
+    DRV_DBG(NAME " read %d bytes successfully\n", copy_len);
     return copy_len; 
 }
 ssize_t led_write (struct file *filp, const char __user *buf, size_t count, loff_t *ppos)
 {
     int ret = 0;
-    printk(NAME " write %d\n", count);
+    DRV_DBG(NAME " write %d\n", count);
 
     if(count >= sizeof(write_buf)) count = sizeof(write_buf) - 1;
     
     ret = copy_from_user(write_buf, buf, count); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_from_user failed %d\n", ret);
+        DRV_DBG(NAME " copy_from_user failed %d\n", ret);
         return -EFAULT;
     }
 
     write_buf[count] = '\0'; // null terminate the string
-    printk(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
+    DRV_DBG(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
 
     if(strncmp(write_buf, "on", 2) == 0) {
         led_on();
-        printk(NAME " led on\n");
+        DRV_DBG(NAME " led on\n");
     } else if(strncmp(write_buf, "off", 3) == 0) {
         led_off();
-        printk(NAME " led off\n");
+        DRV_DBG(NAME " led off\n");
     } else {
-        printk(NAME " invalid command\n");
+        DRV_DBG(NAME " invalid command\n");
     }
 
     return count;
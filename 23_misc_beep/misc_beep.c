@@ -11,9 +11,16 @@
 #include <linux/device.h> // device functions
 #include <linux/gpio.h> // gpio function
 #include <linux/of_gpio.h> // of_get_named_gpio
+#include <linux/delay.h> // udelay, usleep_range
+#include <linux/sched.h> // signal_pending
+
+#include "gpio_cmd.h"
+#include "drv_debug.h"
 
 #define NAME "misc_beep"
 
+#define GPIO_CMD_CHUNK  64  // commands copied from userspace per pass
+
 
 struct beep_dev {
     struct miscdevice dev;
@@ -24,6 +31,8 @@ struct beep_dev {
 
 static void beep_on(struct beep_dev *dev);
 static void beep_off(struct beep_dev *dev);
+static void beep_toggle(struct beep_dev *dev);
+static ssize_t beep_write_cmds(struct beep_dev *dev, const char __user *buf, size_t count);
 
 static int beep_open(struct inode *inode, struct file *file);
 static int beep_release(struct inode *inode, struct file *file);
@@ -41,12 +50,12 @@ static const struct file_operations beep_fops = {
 int beep_open(struct inode *inode, struct file *file)
 {
     struct beep_dev *dev = container_of(file->private_data, struct beep_dev, dev);
-    printk(NAME " open\n");
+    DRV_DBG(NAME " open\n");
     return 0;
 }
 int beep_release(struct inode *inode, struct file *file)
 {
-    printk(NAME " release\n");
+    DRV_DBG(NAME " release\n");
     return 0;
 }
 
@@ -70,6 +79,10 @@ ssize_t beep_write(struct file *file, const char __user *buf, size_t count, loff
     struct beep_dev *dev = container_of(file->private_data, struct beep_dev, dev);
     char write_buf[8];
     size_t len = min(count, sizeof(write_buf) - 1);
+    u8 magic;
+
+    if (count && !get_user(magic, buf) && magic == GPIO_CMD_MAGIC)
+        return beep_write_cmds(dev, buf, count);
 
     if (copy_from_user(write_buf, buf, len))
         return -EFAULT;
@@ -114,6 +127,83 @@ static void beep_toggle(struct beep_dev *dev)
     }
 }
 
+/* binary commands, see gpio_cmd.h; no logging per command */
+static ssize_t beep_write_cmds(struct beep_dev *dev, const char __user *buf, size_t count)
+{
+    struct gpio_cmd_hdr hdr;
+    struct gpio_cmd cmds[GPIO_CMD_CHUNK];
+    u32 delay_us = 0;
+    int done, n, i;
+    ssize_t ret;
+
+    if (count < sizeof(hdr))
+        return -EINVAL;
+    if (copy_from_user(&hdr, buf, sizeof(hdr)))
+        return -EFAULT;
+    if (hdr.version != GPIO_CMD_VERSION || hdr.count > GPIO_CMD_MAX ||
+        count != sizeof(hdr) + hdr.count * sizeof(struct gpio_cmd))
+        return -EINVAL;
+    buf += sizeof(hdr);
+
+    /* check the whole batch first, a bad command must not follow ones that already ran */
+    for (done = 0; done < hdr.count; done += n) {
+        n = min_t(int, hdr.count - done, GPIO_CMD_CHUNK);
+        if (copy_from_user(cmds, buf + done * sizeof(struct gpio_cmd), n * sizeof(struct gpio_cmd)))
+            return -EFAULT;
+        if (gpio_cmd_check(cmds, n, &delay_us))
+            return -EINVAL;
+    }
+
+    /* run it, each chunk is checked again as userspace may rewrite the buffer meanwhile */
+    delay_us = 0;
+    for (done = 0; done < hdr.count; done += n) {
+        n = min_t(int, hdr.count - done, GPIO_CMD_CHUNK);
+        if (copy_from_user(cmds, buf + done * sizeof(struct gpio_cmd), n * sizeof(struct gpio_cmd))) {
+            ret = -EFAULT;
+            goto stop;
+        }
+        if (gpio_cmd_check(cmds, n, &delay_us)) {
+            ret = -EINVAL;
+            goto stop;
+        }
+
+        for (i = 0; i < n; i++) {
+            /* a batch of delays must not hold the caller beyond a signal */
+            if (signal_pending(current)) {
+                done += i;
+                ret = -EINTR;
+                goto stop;
+            }
+
+            switch (cmds[i].op) {
+            case GPIO_CMD_OFF:
+                beep_off(dev);
+                break;
+            case GPIO_CMD_ON:
+                beep_on(dev);
+                break;
+            case GPIO_CMD_TOGGLE:
+                beep_toggle(dev);
+                break;
+            case GPIO_CMD_DELAY:
+                if (cmds[i].arg < 10)
+                    udelay(cmds[i].arg);
+                else
+                    usleep_range(cmds[i].arg, cmds[i].arg + cmds[i].arg / 8);
+                break;
+            }
+        }
+    }
+
+    return count;
+
+stop:
+    /* report the commands that ran, the error only when none did */
+    if (done == 0)
+        return ret;
+    return sizeof(hdr) + done * sizeof(struct gpio_cmd);
+}
+
 // probe
 static int beep_probe(struct platform_device *pdev)
 {
@@ -13,52 +13,128 @@
 #include <linux/input.h>
 #include <linux/interrupt.h>
 #include <linux/of_irq.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/pm_wakeup.h>
 
 #define NAME "input"
 
-#define KEY_COUNT   1
 #define KEY_DEBOUNCE_TIME_MS 10
 
+/*
+ * DT node:
+ *
+ *   key {
+ *       compatible = "alpha-key";
+ *       key-gpios = <&gpio1 18 GPIO_ACTIVE_LOW>, ...;
+ *       linux,code = <KEY_ENTER>, ...;    optional, one per gpio, default KEY_ENTER
+ *       wakeup-source;                    optional, keys wake the system
+ *   };
+ */
+
+static bool fast_press;
+module_param(fast_press, bool, 0644);
+MODULE_PARM_DESC(fast_press, "Report a press on its first edge, debounce only the release");
+
+struct key_dev;
+
 struct key_desc {
     int gpio;
     int irq;
     int keycode;
+    bool active_low;
+    bool pressed;           // last state reported to the input core
     char name[16];
     struct timer_list timer;
+    struct key_dev *keydev;
 };
 
 struct key_dev {
+    struct device *dev;
     struct input_dev *input;
-    struct key_desc keys[KEY_COUNT];
+    spinlock_t lock;        // pressed vs. irq and timer
+    bool wakeup;
+    int key_count;
+    struct key_desc *keys;
 };
 
+static bool key_get_pressed(struct key_desc *key)
+{
+    int val = gpio_get_value(key->gpio) ? 1 : 0;
+
+    return key->active_low ? !val : val;
+}
+
+// report a state change, called with keydev->lock held
+static void key_report(struct key_desc *key, bool pressed)
+{
+    if (key->pressed == pressed)
+        return;
+
+    key->pressed = pressed;
+    input_report_key(key->keydev->input, key->keycode, pressed);
+    input_sync(key->keydev->input);
+}
+
 static void key_timer_handler(unsigned long data)
 {
     struct key_desc *key = (struct key_desc *)data;
-    struct key_dev *keydev = container_of(key, struct key_dev, keys[0]);
-    int val = gpio_get_value(key->gpio);
-    
-    input_report_key(keydev->input, key->keycode, !val);
-    input_sync(keydev->input);
+    struct key_dev *keydev = key->keydev;
+    unsigned long flags;
+
+    spin_lock_irqsave(&keydev->lock, flags);
+    key_report(key, key_get_pressed(key));
+    spin_unlock_irqrestore(&keydev->lock, flags);
 }
 
 static irqreturn_t key_irq_handler(int irq, void *data)
 {
     struct key_desc *key = (struct key_desc *)data;
-    
+    struct key_dev *keydev = key->keydev;
+
+    if (keydev->wakeup)
+        pm_wakeup_event(keydev->dev, KEY_DEBOUNCE_TIME_MS);
+
+    /*
+     * Fast path: a released key that reads pressed is reported now. The
+     * rest of its bounce only restarts the timer below, which settles
+     * the release the usual way.
+     */
+    if (fast_press) {
+        spin_lock(&keydev->lock);
+        if (!key->pressed && key_get_pressed(key))
+            key_report(key, true);
+        spin_unlock(&keydev->lock);
+    }
+
     mod_timer(&key->timer, jiffies + msecs_to_jiffies(KEY_DEBOUNCE_TIME_MS));
     return IRQ_HANDLED;
 }
 
 static int key_probe(struct platform_device *pdev)
 {
+    struct device_node *np = pdev->dev.of_node;
     struct key_dev *keydev;
+    struct key_desc *key;
+    enum of_gpio_flags flags;
+    u32 code;
     int ret, i;
 
     keydev = devm_kzalloc(&pdev->dev, sizeof(*keydev), GFP_KERNEL);
     if (!keydev)
         return -ENOMEM;
-    
+    keydev->dev = &pdev->dev;
+    spin_lock_init(&keydev->lock);
+
+    keydev->key_count = of_gpio_named_count(np, "key-gpios");
+    if (keydev->key_count <= 0) {
+        dev_err(&pdev->dev, "No key-gpios\n");
+        return -EINVAL;
+    }
+    keydev->keys = devm_kcalloc(&pdev->dev, keydev->key_count, sizeof(*keydev->keys), GFP_KERNEL);
+    if (!keydev->keys)
+        return -ENOMEM;
+
     // Allocate input device
     keydev->input = devm_input_allocate_device(&pdev->dev);
     if (!keydev->input)
@@ -66,45 +142,58 @@ static int key_probe(struct platform_device *pdev)
 
     keydev->input->name = "IMX6ULL Key";
     keydev->input->id.bustype = BUS_HOST;
-    
+    keydev->input->dev.parent = &pdev->dev;
+
     // Set input capabilities
     __set_bit(EV_KEY, keydev->input->evbit);
     __set_bit(EV_REP, keydev->input->evbit);
-    __set_bit(KEY_ENTER, keydev->input->keybit);
+
+    keydev->wakeup = of_property_read_bool(np, "wakeup-source") ||
+                     of_property_read_bool(np, "gpio-key,wakeup");
 
     // Initialize keys
-    for (i = 0; i < KEY_COUNT; i++) {
-        keydev->keys[i].gpio = of_get_named_gpio(pdev->dev.of_node, "key-gpios", i);
-        if (keydev->keys[i].gpio < 0) {
+    for (i = 0; i < keydev->key_count; i++) {
+        key = &keydev->keys[i];
+        key->keydev = keydev;
+
+        key->gpio = of_get_named_gpio_flags(np, "key-gpios", i, &flags);
+        if (key->gpio < 0) {
             dev_err(&pdev->dev, "Failed to get GPIO %d\n", i);
-            return keydev->keys[i].gpio;
+            return key->gpio;
         }
+        key->active_low = flags & OF_GPIO_ACTIVE_LOW;
 
-        keydev->keys[i].keycode = KEY_ENTER;
-        snprintf(keydev->keys[i].name, sizeof(keydev->keys[i].name), "key%d", i);
+        if (of_property_read_u32_index(np, "linux,code", i, &code))
+            code = KEY_ENTER;
+        key->keycode = code;
+        input_set_capability(keydev->input, EV_KEY, key->keycode);
 
-        ret = devm_gpio_request(&pdev->dev, keydev->keys[i].gpio, keydev->keys[i].name);
+        snprintf(key->name, sizeof(key->name), "key%d", i);
+
+        ret = devm_gpio_request(&pdev->dev, key->gpio, key->name);
         if (ret) {
-            dev_err(&pdev->dev, "Failed to request GPIO %d\n", keydev->keys[i].gpio);
+            dev_err(&pdev->dev, "Failed to request GPIO %d\n", key->gpio);
             return ret;
         }
 
-        gpio_direction_input(keydev->keys[i].gpio);
+        gpio_direction_input(key->gpio);
 
         // Setup timer
-        init_timer(&keydev->keys[i].timer);
-        keydev->keys[i].timer.function = key_timer_handler;
-        keydev->keys[i].timer.data = (unsigned long)&keydev->keys[i];
+        init_timer(&key->timer);
+        key->timer.function = key_timer_handler;
+        key->timer.data = (unsigned long)key;
 
         // Setup IRQ
-        keydev->keys[i].irq = gpio_to_irq(keydev->keys[i].gpio);
-        ret = devm_request_irq(&pdev->dev, keydev->keys[i].irq, key_irq_handler,
+        key->irq = gpio_to_irq(key->gpio);
+        ret = devm_request_irq(&pdev->dev, key->irq, key_irq_handler,
                               IRQF_TRIGGER_FALLING | IRQF_TRIGGER_RISING,
-                              keydev->keys[i].name, &keydev->keys[i]);
+                              key->name, key);
         if (ret) {
-            dev_err(&pdev->dev, "Failed to request IRQ %d\n", keydev->keys[i].irq);
+            dev_err(&pdev->dev, "Failed to request IRQ %d\n", key->irq);
             return ret;
         }
+
+        dev_info(&pdev->dev, "%s: gpio %d, code %d\n", key->name, key->gpio, key->keycode);
     }
 
     // Register input device
@@ -114,9 +203,11 @@ static int key_probe(struct platform_device *pdev)
         return ret;
     }
 
+    device_init_wakeup(&pdev->dev, keydev->wakeup);
+
     platform_set_drvdata(pdev, keydev);
     dev_info(&pdev->dev, "Key input driver probed successfully\n");
-    
+
     return 0;
 }
 
@@ -124,15 +215,51 @@ static int key_remove(struct platform_device *pdev)
 {
     struct key_dev *keydev = platform_get_drvdata(pdev);
     int i;
-    
-    for (i = 0; i < KEY_COUNT; i++) {
+
+    device_init_wakeup(&pdev->dev, false);
+
+    // irqs are freed by devres after this, keep them from re-arming the timers
+    for (i = 0; i < keydev->key_count; i++) {
+        disable_irq(keydev->keys[i].irq);
         del_timer_sync(&keydev->keys[i].timer);
     }
-    
+
     input_unregister_device(keydev->input);
     return 0;
 }
 
+#ifdef CONFIG_PM_SLEEP
+static int key_suspend(struct device *dev)
+{
+    struct key_dev *keydev = dev_get_drvdata(dev);
+    int i;
+
+    if (!device_may_wakeup(dev))
+        return 0;
+
+    for (i = 0; i < keydev->key_count; i++)
+        enable_irq_wake(keydev->keys[i].irq);
+
+    return 0;
+}
+
+static int key_resume(struct device *dev)
+{
+    struct key_dev *keydev = dev_get_drvdata(dev);
+    int i;
+
+    if (!device_may_wakeup(dev))
+        return 0;
+
+    for (i = 0; i < keydev->key_count; i++)
+        disable_irq_wake(keydev->keys[i].irq);
+
+    return 0;
+}
+#endif
+
+static SIMPLE_DEV_PM_OPS(key_pm_ops, key_suspend, key_resume);
+
 struct of_device_id key_of_match[] = {
     {.compatible = "alpha-key"},
     {},
@@ -142,6 +269,7 @@ static struct platform_driver key_driver = {
     .driver = {
         .name = "imx6ull-key",
         .of_match_table = key_of_match,
+        .pm = &key_pm_ops,
     },
     .probe = key_probe,
     .remove = key_remove,
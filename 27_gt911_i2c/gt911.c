@@ -1,5 +1,5 @@
 /*
- *  Driver for Goodix Touchscreens
+ *  Driver for Goodix GT9xx Touchscreens (GT911, GT9147, GT928)
  *
  *  Copyright (c) 2014 Red Hat Inc.
  *
@@ -19,48 +19,244 @@
 #include <linux/input.h>
 #include <linux/input/mt.h>
 #include <linux/module.h>
+#include <linux/version.h>
 #include <linux/delay.h>
 #include <linux/irq.h>
 #include <linux/interrupt.h>
 #include <linux/slab.h>
 #include <linux/acpi.h>
 #include <linux/of.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+#include <linux/unaligned.h>
+#else
 #include <asm/unaligned.h>
+#endif
 #include <linux/of_gpio.h>
 #include <linux/of_irq.h>
-
-struct goodix_ts_data {
-	struct i2c_client *client;
-	struct input_dev *input_dev;
-	int abs_x_max;
-	int abs_y_max;
-	unsigned int max_touch_num;
-	unsigned int int_trigger_type;
-
-	int irq_gpio;
-	int reset_gpio;
-};
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/spinlock.h>
+#include <linux/bitops.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/firmware.h>
+#include <linux/of_device.h>
+
+#define CREATE_TRACE_POINTS
+#include "gt911_trace.h"
 
 #define GOODIX_MAX_HEIGHT		4096
 #define GOODIX_MAX_WIDTH		4096
 #define GOODIX_INT_TRIGGER		1
 #define GOODIX_CONTACT_SIZE		8
-#define GOODIX_MAX_CONTACTS		10
 
 #define GOODIX_CONFIG_MAX_LENGTH	240
 // #define GOODIX_CONFIG_MAX_LENGTH	7
 
+#define GOODIX_BUFFER_STATUS_READY	BIT(7)
+#define GOODIX_BUFFER_STATUS_TIMEOUT	20	/* ms */
+
 /* Register defines */
 #define GOODIX_READ_COOR_ADDR		0x814E
 #define GOODIX_REG_CONFIG_DATA		0x8047
 #define GOODIX_REG_VERSION		0x8140
 
 #define GOODIX_CTRL_REG 	        0X8040
+#define GOODIX_REG_REFRESH_RATE		0x8056
+
+/* config block at 0x8047, length includes checksum and fresh flag */
+#define GOODIX_CONFIG_911_LENGTH	186
+#define GOODIX_CONFIG_967_LENGTH	228
+
+/* report period is (5 + N) ms, N in the low nibble of 0x8056 */
+#define GOODIX_REFRESH_RATE_MASK	0x0f
+#define GOODIX_REFRESH_BASE_MS		5
+
+/* Largest register write: 2-byte address + full config block */
+#define GOODIX_WBUF_SIZE		(2 + GOODIX_CONFIG_MAX_LENGTH)
+
+/* track ids are the low nibble of the first contact byte */
+#define GOODIX_MAX_TRACK_ID		16
 
 #define RESOLUTION_LOC		1
 #define MAX_CONTACTS_LOC	5
 #define TRIGGER_LOC		6
 
+/* Stages of one touch frame, from the INT edge to the status clear */
+enum goodix_stage {
+	GOODIX_STAGE_WAKEUP,	/* hard IRQ to IRQ thread running */
+	GOODIX_STAGE_READ,	/* status poll + coordinate read */
+	GOODIX_STAGE_REPORT,	/* input_report_* up to input_sync() */
+	GOODIX_STAGE_CLEAR,	/* status register clear */
+	GOODIX_STAGE_TOTAL,	/* hard IRQ to clear done */
+	GOODIX_STAGE_NUM,
+};
+
+/*
+ * Latency histogram in microseconds: 8 linear buckets, then 8 buckets
+ * per power of two, so every bucket is within 12.5% of its value.
+ * 160 buckets reach past one second; anything above lands in the last.
+ */
+#define GOODIX_HIST_SUB_BITS	3
+#define GOODIX_HIST_SUB		(1 << GOODIX_HIST_SUB_BITS)
+#define GOODIX_HIST_BUCKETS	160
+
+struct goodix_stage_stat {
+	u64 count;
+	u64 sum_ns;
+	u64 min_ns;
+	u64 max_ns;
+	u32 hist[GOODIX_HIST_BUCKETS];
+};
+
+/* Per track id state for the in-driver filter */
+struct goodix_contact {
+	bool active;
+	bool palm;		/* rejected until lifted, holds no slot */
+	bool dirty;		/* position changed since last emitted */
+	int slot;
+	int fx, fy;		/* IIR filtered position, Q8 */
+	int rx, ry;		/* last position handed to the input core */
+	int rw;			/* last width handed to the input core */
+};
+
+/*
+ * Per chip variant, selected by compatible and cross-checked against
+ * the product id the controller reports at 0x8140.
+ */
+struct goodix_chip_data {
+	const char *id;			/* product id string, e.g. "911" */
+	u16 clear_reg;			/* written with 0 to ack a frame */
+	int config_len;			/* config block incl. checksum + fresh */
+	unsigned int max_contacts;
+};
+
+struct goodix_ts_data {
+	struct i2c_client *client;
+	struct input_dev *input_dev;
+	const struct goodix_chip_data *chip;
+	char id[5];
+	u16 version;
+	int abs_x_max;
+	int abs_y_max;
+	unsigned int max_touch_num;
+	unsigned int int_trigger_type;
+
+	int irq_gpio;
+	int reset_gpio;
+
+	/*
+	 * Coordinate transform from DT touchscreen-* properties: swap, then
+	 * scale (Q16, 0 = none) to touchscreen-size-*, then invert.
+	 */
+	bool swap_xy;
+	bool invert_x;
+	bool invert_y;
+	int out_x_max;
+	int out_y_max;
+	u32 scale_x;
+	u32 scale_y;
+
+	/* jitter filter, both 0 = off */
+	u32 filter_shift;	/* IIR weight of a new sample is 1/2^shift */
+	u32 jitter_px;		/* hysteresis before a move is reported */
+	u32 palm_width;		/* contacts this wide are dropped, 0 = off */
+
+	struct goodix_contact contacts[GOODIX_MAX_TRACK_ID];
+	unsigned long used_slots;
+	u16 frame_ids;		/* track ids seen in the current frame */
+	u16 prev_ids;		/* track ids of the previous frame */
+	ktime_t last_sync;	/* last frame handed to input_sync() */
+
+	/* kmalloc'ed at probe so the touch path never allocates */
+	struct mutex wbuf_lock;	/* register address/payload staging, all transfers */
+	u8 *wbuf;
+	u8 *point_data;
+
+	/* last config read from or written to the controller */
+	struct mutex cfg_lock;
+	u8 config[GOODIX_CONFIG_MAX_LENGTH];
+	bool config_valid;	/* config[] holds what the controller reported */
+
+	ktime_t irq_time;	/* INT edge, stamped by the hard handler */
+
+	/* polling mode, used instead of the INT line */
+	bool polling;
+	bool poll_stop;
+	bool contacts_down;	/* last reported frame had fingers */
+	u32 poll_interval_us;	/* current, grows while idle */
+	struct hrtimer poll_timer;
+	struct work_struct poll_work;
+
+	struct dentry *debugfs_dir;
+	spinlock_t stat_lock;
+	struct goodix_stage_stat stat[GOODIX_STAGE_NUM];
+	u64 not_ready_polls;	/* status reads that found no data yet */
+	u64 not_ready_timeouts;	/* frames abandoned without data */
+	u64 palm_rejected;	/* contacts dropped as palms */
+	u64 frames_coalesced;	/* motion-only frames merged into the next */
+};
+
+/*
+ * All of these ack a frame by clearing the buffer status at 0x814E.
+ * Writing 0 to the command register 0x8040 only selects coordinate
+ * mode and leaves the status set, so the next INT can be missed.
+ */
+static const struct goodix_chip_data gt911_chip_data = {
+	.id = "911",
+	.clear_reg = GOODIX_READ_COOR_ADDR,
+	.config_len = GOODIX_CONFIG_911_LENGTH,
+	.max_contacts = 5,
+};
+
+static const struct goodix_chip_data gt9147_chip_data = {
+	.id = "9147",
+	.clear_reg = GOODIX_READ_COOR_ADDR,
+	.config_len = GOODIX_CONFIG_967_LENGTH,
+	.max_contacts = 5,
+};
+
+static const struct goodix_chip_data gt928_chip_data = {
+	.id = "928",
+	.clear_reg = GOODIX_READ_COOR_ADDR,
+	.config_len = GOODIX_CONFIG_911_LENGTH,
+	.max_contacts = 10,
+};
+
+static const struct goodix_chip_data *goodix_chips[] = {
+	&gt911_chip_data,
+	&gt9147_chip_data,
+	&gt928_chip_data,
+};
+
+static const struct of_device_id goodix_of_match[] = {
+	{ .compatible = "goodix,gt911", .data = &gt911_chip_data },
+	{ .compatible = "goodix,gt9147", .data = &gt9147_chip_data },
+	{ .compatible = "goodix,gt928", .data = &gt928_chip_data },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, goodix_of_match);
+
+static bool polling;
+module_param(polling, bool, 0444);
+MODULE_PARM_DESC(polling, "Poll the controller instead of using the INT line");
+
+static unsigned int poll_fast_us = 5000;
+module_param(poll_fast_us, uint, 0644);
+MODULE_PARM_DESC(poll_fast_us, "Polling period while touched (us)");
+
+static unsigned int coalesce_us;
+module_param(coalesce_us, uint, 0644);
+MODULE_PARM_DESC(coalesce_us,
+		 "Merge motion-only frames closer than this (us), 0 = off");
+
+static unsigned int poll_idle_max_us = 100000;
+module_param(poll_idle_max_us, uint, 0644);
+MODULE_PARM_DESC(poll_idle_max_us, "Longest polling period when idle (us)");
+
 static const unsigned long goodix_irq_flags[] = {
 	IRQ_TYPE_EDGE_RISING,
 	IRQ_TYPE_EDGE_FALLING,
@@ -71,22 +267,31 @@ static const unsigned long goodix_irq_flags[] = {
 /**
  * goodix_i2c_read - read data from a register of the i2c slave device.
  *
- * @client: i2c device.
+ * @ts: our goodix_ts_data pointer
  * @reg: the register to read from.
- * @buf: raw write data buffer.
- * @len: length of the buffer to write
+ * @buf: buffer to read into, must not be on the stack.
+ * @len: length of the buffer to read
+ *
+ * The register address is staged in the preallocated ts->wbuf, so no
+ * part of the transfer lives on the stack.
  */
-static int goodix_i2c_read(struct i2c_client *client,
+static int goodix_i2c_read(struct goodix_ts_data *ts,
 				u16 reg, u8 *buf, int len)
 {
+	struct i2c_client *client = ts->client;
 	struct i2c_msg msgs[2];
-	u16 wbuf = cpu_to_be16(reg);
 	int ret;
 
+	trace_gt911_read_start(reg, len);
+
+	mutex_lock(&ts->wbuf_lock);
+	ts->wbuf[0] = reg >> 8;
+	ts->wbuf[1] = reg & 0xFF;
+
 	msgs[0].flags = 0;
 	msgs[0].addr  = client->addr;
 	msgs[0].len   = 2;
-	msgs[0].buf   = (u8 *) &wbuf;
+	msgs[0].buf   = ts->wbuf;
 
 	msgs[1].flags = I2C_M_RD;
 	msgs[1].addr  = client->addr;
@@ -94,49 +299,138 @@ static int goodix_i2c_read(struct i2c_client *client,
 	msgs[1].buf   = buf;
 
 	ret = i2c_transfer(client->adapter, msgs, 2);
-	return ret < 0 ? ret : (ret != ARRAY_SIZE(msgs) ? -EIO : 0);
+	mutex_unlock(&ts->wbuf_lock);
+	ret = ret < 0 ? ret : (ret != ARRAY_SIZE(msgs) ? -EIO : 0);
+
+	trace_gt911_read_end(reg, len, ret);
+	return ret;
 }
 
-static int goodix_i2c_write(struct i2c_client *client,
-				u16 reg, u8 *buf, int len)
+/**
+ * goodix_i2c_write - write data to a register of the i2c slave device.
+ *
+ * @ts: our goodix_ts_data pointer
+ * @reg: the register to write to.
+ * @buf: raw data buffer to write.
+ * @len: length of the buffer to write
+ *
+ * The address and payload are staged in the preallocated ts->wbuf, so
+ * this is safe to call from the IRQ thread without touching the heap.
+ */
+static int goodix_i2c_write(struct goodix_ts_data *ts,
+				u16 reg, const u8 *buf, int len)
 {
+	struct i2c_client *client = ts->client;
 	struct i2c_msg msg;
-	u8 *wbuf;
 	int ret;
 
-	wbuf = kzalloc(len + 2, GFP_KERNEL);
-	if (!wbuf)
-		return -ENOMEM;
+	if (len > GOODIX_WBUF_SIZE - 2)
+		return -EINVAL;
 
-	wbuf[0] = reg >> 8;
-	wbuf[1] = reg & 0xFF;
-	memcpy(&wbuf[2], buf, len);
+	mutex_lock(&ts->wbuf_lock);
+	ts->wbuf[0] = reg >> 8;
+	ts->wbuf[1] = reg & 0xFF;
+	memcpy(&ts->wbuf[2], buf, len);
 
 	msg.flags = 0;
 	msg.addr = client->addr;
 	msg.len = len + 2;
-	msg.buf = wbuf;
+	msg.buf = ts->wbuf;
 
 	ret = i2c_transfer(client->adapter, &msg, 1);
-	kfree(wbuf);
+	mutex_unlock(&ts->wbuf_lock);
 
 	return ret < 0 ? ret : (ret != 1 ? -EIO : 0);
 }
 
+static unsigned int goodix_hist_bucket(u64 ns)
+{
+	u32 us = min_t(u64, div_u64(ns, NSEC_PER_USEC), U32_MAX);
+	unsigned int msb, bucket;
+
+	if (us < GOODIX_HIST_SUB)
+		return us;
+
+	msb = fls(us) - 1;
+	bucket = (msb - GOODIX_HIST_SUB_BITS + 1) * GOODIX_HIST_SUB +
+		 ((us >> (msb - GOODIX_HIST_SUB_BITS)) & (GOODIX_HIST_SUB - 1));
+
+	return min_t(unsigned int, bucket, GOODIX_HIST_BUCKETS - 1);
+}
+
+/* Lowest value in microseconds that falls into @bucket */
+static u64 goodix_hist_floor_us(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < GOODIX_HIST_SUB)
+		return bucket;
+
+	shift = bucket / GOODIX_HIST_SUB - 1;
+	return (u64)(GOODIX_HIST_SUB + bucket % GOODIX_HIST_SUB) << shift;
+}
+
+static void goodix_stat_add(struct goodix_ts_data *ts, enum goodix_stage stage,
+			    ktime_t start, ktime_t end)
+{
+	struct goodix_stage_stat *st = &ts->stat[stage];
+	u64 ns = ktime_to_ns(ktime_sub(end, start));
+	unsigned long flags;
+
+	spin_lock_irqsave(&ts->stat_lock, flags);
+	if (!st->count || ns < st->min_ns)
+		st->min_ns = ns;
+	if (ns > st->max_ns)
+		st->max_ns = ns;
+	st->count++;
+	st->sum_ns += ns;
+	st->hist[goodix_hist_bucket(ns)]++;
+	spin_unlock_irqrestore(&ts->stat_lock, flags);
+}
+
+/**
+ * goodix_ts_read_input_report - Read the coordinate buffer
+ *
+ * @ts: our goodix_ts_data pointer
+ * @data: destination, 1 status byte + max_touch_num contacts
+ *
+ * The status byte and first contact come back in one transfer. Bit 7 of
+ * the status tells whether the controller has finished filling the
+ * buffer; only if it has not do we back off and poll again, instead of
+ * sleeping a fixed time before every read.
+ */
 static int goodix_ts_read_input_report(struct goodix_ts_data *ts, u8 *data)
 {
+	unsigned long timeout;
 	int touch_num;
 	int error;
-	
-	// msleep(1);
-	usleep_range(1000, 2000);
-	// printk("r\n");
 
-	error = goodix_i2c_read(ts->client, GOODIX_READ_COOR_ADDR, data,
-				GOODIX_CONTACT_SIZE + 1);
-	if (error) {
-		dev_err(&ts->client->dev, "I2C transfer error: %d\n", error);
-		return error;
+	timeout = jiffies + msecs_to_jiffies(GOODIX_BUFFER_STATUS_TIMEOUT);
+	for (;;) {
+		error = goodix_i2c_read(ts, GOODIX_READ_COOR_ADDR, data,
+					GOODIX_CONTACT_SIZE + 1);
+		if (error) {
+			dev_err(&ts->client->dev, "I2C transfer error: %d\n", error);
+			return error;
+		}
+
+		if (data[0] & GOODIX_BUFFER_STATUS_READY)
+			break;
+
+		/* when polling, not ready just means no new frame yet */
+		if (ts->polling)
+			return -EAGAIN;
+
+		ts->not_ready_polls++;
+		if (time_after(jiffies, timeout)) {
+			/*
+			 * The panel raises a spurious INT after finger up
+			 * without setting the ready bit; report no contacts.
+			 */
+			ts->not_ready_timeouts++;
+			return 0;
+		}
+		usleep_range(200, 500);
 	}
 
 	touch_num = data[0] & 0x0f;
@@ -145,7 +439,7 @@ static int goodix_ts_read_input_report(struct goodix_ts_data *ts, u8 *data)
 
 	if (touch_num > 1) {
 		data += 1 + GOODIX_CONTACT_SIZE;
-		error = goodix_i2c_read(ts->client,
+		error = goodix_i2c_read(ts,
 					GOODIX_READ_COOR_ADDR +
 						1 + GOODIX_CONTACT_SIZE,
 					data,
@@ -157,19 +451,225 @@ static int goodix_ts_read_input_report(struct goodix_ts_data *ts, u8 *data)
 	return touch_num;
 }
 
-static void goodix_ts_report_touch(struct goodix_ts_data *ts, u8 *coor_data)
+/* Swap, scale and invert a raw controller position into output space */
+static void goodix_ts_transform(struct goodix_ts_data *ts, int *x, int *y)
 {
+	if (ts->swap_xy)
+		swap(*x, *y);
+
+	if (ts->scale_x)
+		*x = ((u64)*x * ts->scale_x) >> 16;
+	if (ts->scale_y)
+		*y = ((u64)*y * ts->scale_y) >> 16;
+
+	*x = clamp(*x, 0, ts->out_x_max);
+	*y = clamp(*y, 0, ts->out_y_max);
+
+	if (ts->invert_x)
+		*x = ts->out_x_max - *x;
+	if (ts->invert_y)
+		*y = ts->out_y_max - *y;
+}
+
+/*
+ * Smooth a position with a first order IIR in Q8 and only move the
+ * reported point once it drifted jitter_px away from the last one.
+ * Unchanged values are then dropped by the input core, so a resting
+ * finger stops generating ABS events.
+ */
+static void goodix_ts_filter(struct goodix_ts_data *ts,
+			     struct goodix_contact *c, int *x, int *y)
+{
+	if (ts->filter_shift) {
+		c->fx += ((*x << 8) - c->fx) >> ts->filter_shift;
+		c->fy += ((*y << 8) - c->fy) >> ts->filter_shift;
+		*x = (c->fx + 128) >> 8;
+		*y = (c->fy + 128) >> 8;
+	}
+
+	if (abs(*x - c->rx) < ts->jitter_px &&
+	    abs(*y - c->ry) < ts->jitter_px) {
+		*x = c->rx;
+		*y = c->ry;
+	} else {
+		c->rx = *x;
+		c->ry = *y;
+	}
+}
+
+/*
+ * Bind a controller track id to a free MT slot on touch down, so ids
+ * above max_touch_num still get reported and a new contact never
+ * inherits filter state from an old one.
+ */
+static struct goodix_contact *goodix_ts_track(struct goodix_ts_data *ts,
+					      int id, int x, int y, int w)
+{
+	struct goodix_contact *c = &ts->contacts[id];
+	bool palm = ts->palm_width && w >= ts->palm_width;
+	int slot;
+
+	ts->frame_ids |= BIT(id);
+
+	/*
+	 * A palm stays rejected until it is lifted. A finger that grows into
+	 * a palm gives up its slot, which input_mt_sync_frame() then reports
+	 * as released.
+	 */
+	if (c->active && (c->palm || !palm))
+		return c->palm ? NULL : c;
+
+	if (palm) {
+		if (c->active)
+			__clear_bit(c->slot, &ts->used_slots);
+		c->active = true;
+		c->palm = true;
+		ts->palm_rejected++;
+		return NULL;
+	}
+
+	slot = find_first_zero_bit(&ts->used_slots, ts->max_touch_num);
+	if (slot >= ts->max_touch_num)
+		return NULL;
+
+	__set_bit(slot, &ts->used_slots);
+	c->active = true;
+	c->palm = false;
+	c->dirty = true;
+	c->slot = slot;
+	c->fx = x << 8;
+	c->fy = y << 8;
+	c->rx = x;
+	c->ry = y;
+	c->rw = -1;
+
+	return c;
+}
+
+/* Free the slots of contacts that were missing from this frame */
+static void goodix_ts_release_contacts(struct goodix_ts_data *ts)
+{
+	struct goodix_contact *c;
+	int id;
+
+	for (id = 0; id < GOODIX_MAX_TRACK_ID; id++) {
+		c = &ts->contacts[id];
+		if (c->active && !(ts->frame_ids & BIT(id))) {
+			if (!c->palm)
+				__clear_bit(c->slot, &ts->used_slots);
+			c->active = false;
+		}
+	}
+	ts->prev_ids = ts->frame_ids;
+	ts->frame_ids = 0;
+}
+
+/*
+ * A frame may be held back only if it carries no touch down or up and
+ * the previous one went out less than coalesce_us ago; the contacts'
+ * latest positions then go out with the next frame. The evdev client
+ * queues are not visible from here, so the interval stands in for a
+ * backlogged reader.
+ */
+static bool goodix_ts_coalesce(struct goodix_ts_data *ts, const u8 *point_data,
+			       int touch_num, ktime_t now)
+{
+	u16 ids = 0;
+	int i;
+
+	if (!coalesce_us || !touch_num)
+		return false;
+
+	for (i = 0; i < touch_num; i++)
+		ids |= BIT(point_data[1 + GOODIX_CONTACT_SIZE * i] & 0x0F);
+
+	return ids == ts->prev_ids &&
+	       ktime_us_delta(now, ts->last_sync) < coalesce_us;
+}
+
+/*
+ * Held positions normally go out with the next frame, but a contact that
+ * is lifted in that frame loses its slot there and its last position
+ * would never be reported. Send the held positions as a frame of their
+ * own first whenever a dirty contact is missing from the new frame.
+ */
+static void goodix_ts_flush_held(struct goodix_ts_data *ts,
+				 const u8 *point_data, int touch_num)
+{
+	struct goodix_contact *c;
+	bool lifted = false;
+	u16 ids = 0;
+	int id, i;
+
+	for (i = 0; i < touch_num; i++)
+		ids |= BIT(point_data[1 + GOODIX_CONTACT_SIZE * i] & 0x0F);
+
+	for (id = 0; id < GOODIX_MAX_TRACK_ID; id++) {
+		c = &ts->contacts[id];
+		if (c->active && !c->palm && c->dirty && !(ids & BIT(id)))
+			lifted = true;
+	}
+	if (!lifted)
+		return;
+
+	/* every live slot goes in, input_mt_sync_frame() drops the rest */
+	for (id = 0; id < GOODIX_MAX_TRACK_ID; id++) {
+		c = &ts->contacts[id];
+		if (!c->active || c->palm)
+			continue;
+
+		input_mt_slot(ts->input_dev, c->slot);
+		input_mt_report_slot_state(ts->input_dev, MT_TOOL_FINGER, true);
+		if (c->dirty) {
+			input_report_abs(ts->input_dev, ABS_MT_POSITION_X, c->rx);
+			input_report_abs(ts->input_dev, ABS_MT_POSITION_Y, c->ry);
+			c->dirty = false;
+		}
+	}
+	input_mt_sync_frame(ts->input_dev);
+	input_sync(ts->input_dev);
+}
+
+/*
+ * With @hold set only the filter state is updated. Otherwise the slot
+ * is kept alive and the position is reported only if it changed since
+ * the last emitted frame.
+ */
+static void goodix_ts_report_touch(struct goodix_ts_data *ts, u8 *coor_data,
+				   bool hold)
+{
+	struct goodix_contact *c;
 	int id = coor_data[0] & 0x0F;
 	int input_x = get_unaligned_le16(&coor_data[1]);
 	int input_y = get_unaligned_le16(&coor_data[3]);
 	int input_w = get_unaligned_le16(&coor_data[5]);
+	int old_x, old_y;
+
+	goodix_ts_transform(ts, &input_x, &input_y);
+
+	c = goodix_ts_track(ts, id, input_x, input_y, input_w);
+	if (!c)
+		return;
+
+	old_x = c->rx;
+	old_y = c->ry;
+	goodix_ts_filter(ts, c, &input_x, &input_y);
+	if (input_x != old_x || input_y != old_y)
+		c->dirty = true;
+	if (hold)
+		return;
 
-	input_mt_slot(ts->input_dev, id);
+	input_mt_slot(ts->input_dev, c->slot);
 	input_mt_report_slot_state(ts->input_dev, MT_TOOL_FINGER, true);
-	input_report_abs(ts->input_dev, ABS_MT_POSITION_X, input_x);
-	input_report_abs(ts->input_dev, ABS_MT_POSITION_Y, input_y);
-	input_report_abs(ts->input_dev, ABS_MT_TOUCH_MAJOR, input_w);
-	input_report_abs(ts->input_dev, ABS_MT_WIDTH_MAJOR, input_w);
+
+	if (c->dirty || input_w != c->rw) {
+		input_report_abs(ts->input_dev, ABS_MT_POSITION_X, input_x);
+		input_report_abs(ts->input_dev, ABS_MT_POSITION_Y, input_y);
+		input_report_abs(ts->input_dev, ABS_MT_TOUCH_MAJOR, input_w);
+		input_report_abs(ts->input_dev, ABS_MT_WIDTH_MAJOR, input_w);
+		c->rw = input_w;
+		c->dirty = false;
+	}
 }
 
 /**
@@ -178,25 +678,45 @@ static void goodix_ts_report_touch(struct goodix_ts_data *ts, u8 *coor_data)
  * @ts: our goodix_ts_data pointer
  *
  * Called when the IRQ is triggered. Read the current device state, and push
- * the input events to the user space.
+ * the input events to the user space. Returns the number of contacts
+ * reported or a negative error, -EAGAIN if no frame was ready.
  */
-static void goodix_process_events(struct goodix_ts_data *ts)
+static int goodix_process_events(struct goodix_ts_data *ts)
 {
-	u8  point_data[1 + GOODIX_CONTACT_SIZE * ts->max_touch_num];
+	u8 *point_data = ts->point_data;
+	ktime_t start, end;
 	int touch_num;
+	bool hold;
 	int i;
 
+	start = ktime_get();
 	touch_num = goodix_ts_read_input_report(ts, point_data);
-	//printk("touch_num=%d\n", touch_num);
+	end = ktime_get();
+	goodix_stat_add(ts, GOODIX_STAGE_READ, start, end);
 	if (touch_num < 0)
-		return;
+		return touch_num;
 
+	start = end;
+	hold = goodix_ts_coalesce(ts, point_data, touch_num, start);
+	if (!hold)
+		goodix_ts_flush_held(ts, point_data, touch_num);
 	for (i = 0; i < touch_num; i++)
 		goodix_ts_report_touch(ts,
-				&point_data[1 + GOODIX_CONTACT_SIZE * i]);
+				&point_data[1 + GOODIX_CONTACT_SIZE * i], hold);
+	goodix_ts_release_contacts(ts);
+
+	if (hold) {
+		ts->frames_coalesced++;
+		return touch_num;
+	}
 
 	input_mt_sync_frame(ts->input_dev);
 	input_sync(ts->input_dev);
+	ts->last_sync = ktime_get();
+	goodix_stat_add(ts, GOODIX_STAGE_REPORT, start, ts->last_sync);
+	trace_gt911_report(touch_num);
+
+	return touch_num;
 }
 
 
@@ -232,14 +752,15 @@ static int goodix_reset(struct goodix_ts_data *ts)
 }
 
 
-static int goodix_sw_reset(struct i2c_client *client)
+static int goodix_sw_reset(struct goodix_ts_data *ts)
 {
+	struct i2c_client *client = ts->client;
 	u8 reset_cmd = 0x02;
 	u8 clear_cmd = 0x00;
 	int error;
 
 	/* Send software reset command */
-	error = goodix_i2c_write(client, GOODIX_CTRL_REG, &reset_cmd, 1);
+	error = goodix_i2c_write(ts, GOODIX_CTRL_REG, &reset_cmd, 1);
 	if (error) {
 		dev_err(&client->dev, "Software reset failed: %d\n", error);
 		return error;
@@ -248,7 +769,7 @@ static int goodix_sw_reset(struct i2c_client *client)
 	msleep(100);
 
 	/* Clear reset register */
-	error = goodix_i2c_write(client, GOODIX_CTRL_REG, &clear_cmd, 1);
+	error = goodix_i2c_write(ts, GOODIX_CTRL_REG, &clear_cmd, 1);
 	if (error) {
 		dev_err(&client->dev, "Clear reset failed: %d\n", error);
 		return error;
@@ -260,42 +781,347 @@ static int goodix_sw_reset(struct i2c_client *client)
 }
 
 /**
- * goodix_ts_irq_handler - The IRQ handler
+ * goodix_ts_irq_hard - Primary IRQ handler
  *
  * @irq: interrupt number.
  * @dev_id: private data pointer.
+ *
+ * Only timestamps the INT edge; all bus traffic happens in the thread.
  */
-static irqreturn_t goodix_ts_irq_handler(int irq, void *dev_id)
+static irqreturn_t goodix_ts_irq_hard(int irq, void *dev_id)
 {
-	static const u8 end_cmd[] = {
-		GOODIX_READ_COOR_ADDR >> 8,
-		GOODIX_READ_COOR_ADDR & 0xff,
-		0
-	};
 	struct goodix_ts_data *ts = dev_id;
-	// printk("irq\n");
-
-	goodix_process_events(ts);
 
-	// gt911 bug wait
-	usleep_range(50,100);
+	ts->irq_time = ktime_get();
+	trace_gt911_irq(irq);
 
-	// if (i2c_master_send(ts->client, end_cmd, sizeof(end_cmd)) < 0)
-	// 	//dev_err(&ts->client->dev, "I2C write end_cmd error\n");
+	return IRQ_WAKE_THREAD;
+}
 
+/**
+ * goodix_ts_handle_frame - Read, report and acknowledge one frame
+ *
+ * @ts: our goodix_ts_data pointer
+ *
+ * Shared by the IRQ thread and the polling work; ts->irq_time must hold
+ * the moment the frame was signalled. Returns goodix_process_events().
+ */
+static int goodix_ts_handle_frame(struct goodix_ts_data *ts)
+{
+	static const u8 end_cmd = 0;
+	ktime_t start, end;
+	int touch_num;
+	int error;
 
-	// Clear the interrupt by writing 0 to the register
-	if (goodix_i2c_write(ts->client, GOODIX_READ_COOR_ADDR, (u8 *)&end_cmd[2], 1) )
+	goodix_stat_add(ts, GOODIX_STAGE_WAKEUP, ts->irq_time, ktime_get());
+	touch_num = goodix_process_events(ts);
+	if (touch_num == -EAGAIN)
+		return touch_num;
+
+	/*
+	 * Clear the buffer status so the controller can latch the next
+	 * frame. The ready bit polled in the read path already tells us the
+	 * data was complete, so no settle delay is needed around this.
+	 */
+	start = ktime_get();
+	error = goodix_i2c_write(ts, ts->chip->clear_reg, &end_cmd, 1);
+	if (error)
 		dev_err(&ts->client->dev, "I2C write end_cmd error\n");
+	end = ktime_get();
+	trace_gt911_clear(error);
+
+	goodix_stat_add(ts, GOODIX_STAGE_CLEAR, start, end);
+	goodix_stat_add(ts, GOODIX_STAGE_TOTAL, ts->irq_time, end);
+
+	return touch_num;
+}
 
-	usleep_range(100,200);
+/**
+ * goodix_ts_irq_handler - The threaded IRQ handler
+ *
+ * @irq: interrupt number.
+ * @dev_id: private data pointer.
+ */
+static irqreturn_t goodix_ts_irq_handler(int irq, void *dev_id)
+{
+	struct goodix_ts_data *ts = dev_id;
 
-	// test
-	// printk("goodix_ts_irq_handler\n");
+	goodix_ts_handle_frame(ts);
 
 	return IRQ_HANDLED;
 }
 
+static enum hrtimer_restart goodix_poll_timer(struct hrtimer *timer)
+{
+	struct goodix_ts_data *ts = container_of(timer, struct goodix_ts_data,
+						 poll_timer);
+
+	if (!ts->poll_stop) {
+		ts->irq_time = ktime_get();
+		queue_work(system_highpri_wq, &ts->poll_work);
+	}
+
+	return HRTIMER_NORESTART;
+}
+
+/**
+ * goodix_poll_work - Polling mode replacement for the IRQ thread
+ *
+ * @work: the poll_work embedded in goodix_ts_data
+ *
+ * Polls every poll_fast_us while fingers are down. Once the panel goes
+ * idle the period doubles on every empty poll up to poll_idle_max_us,
+ * and drops straight back to the fast rate on the next touch.
+ */
+static void goodix_poll_work(struct work_struct *work)
+{
+	struct goodix_ts_data *ts = container_of(work, struct goodix_ts_data,
+						 poll_work);
+	u32 fast = max(poll_fast_us, 1000U);
+	u32 slow = max(poll_idle_max_us, fast);
+	int touch_num;
+
+	touch_num = goodix_ts_handle_frame(ts);
+
+	if (touch_num >= 0)
+		ts->contacts_down = touch_num > 0;
+
+	if (touch_num >= 0 || ts->contacts_down)
+		ts->poll_interval_us = fast;
+	else
+		ts->poll_interval_us = min(ts->poll_interval_us * 2, slow);
+
+	if (!ts->poll_stop)
+		hrtimer_start(&ts->poll_timer,
+			      ns_to_ktime((u64)ts->poll_interval_us *
+					  NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+}
+
+static void goodix_poll_stop(void *data)
+{
+	struct goodix_ts_data *ts = data;
+
+	ts->poll_stop = true;
+	/*
+	 * A running work may have read poll_stop before it was set and re-arm
+	 * the timer, so flush it before cancelling the timer. A timer already
+	 * in its callback may still queue one more work; flush that too.
+	 */
+	cancel_work_sync(&ts->poll_work);
+	hrtimer_cancel(&ts->poll_timer);
+	cancel_work_sync(&ts->poll_work);
+}
+
+static int goodix_poll_start(struct goodix_ts_data *ts)
+{
+	int error;
+
+	ts->polling = true;
+	ts->poll_interval_us = max(poll_fast_us, 1000U);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&ts->poll_timer, goodix_poll_timer, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL);
+#else
+	hrtimer_init(&ts->poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	ts->poll_timer.function = goodix_poll_timer;
+#endif
+	INIT_WORK(&ts->poll_work, goodix_poll_work);
+
+	error = devm_add_action(&ts->client->dev, goodix_poll_stop, ts);
+	if (error)
+		return error;
+
+	hrtimer_start(&ts->poll_timer,
+		      ns_to_ktime((u64)ts->poll_interval_us * NSEC_PER_USEC),
+		      HRTIMER_MODE_REL);
+
+	dev_info(&ts->client->dev, "polling mode, %u-%u us\n",
+		 ts->poll_interval_us, max(poll_idle_max_us,
+					   ts->poll_interval_us));
+	return 0;
+}
+
+static const char * const goodix_stage_names[GOODIX_STAGE_NUM] = {
+	[GOODIX_STAGE_WAKEUP]	= "wakeup",
+	[GOODIX_STAGE_READ]	= "read",
+	[GOODIX_STAGE_REPORT]	= "report",
+	[GOODIX_STAGE_CLEAR]	= "clear",
+	[GOODIX_STAGE_TOTAL]	= "total",
+};
+
+/* Upper bound, in microseconds, of the bucket holding the pct'th sample */
+static u64 goodix_hist_percentile(const struct goodix_stage_stat *st,
+				  unsigned int pct)
+{
+	u64 target = div_u64(st->count * pct + 99, 100);
+	u64 seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < GOODIX_HIST_BUCKETS; i++) {
+		seen += st->hist[i];
+		if (seen >= target)
+			break;
+	}
+	if (i >= GOODIX_HIST_BUCKETS - 1)
+		return div_u64(st->max_ns, NSEC_PER_USEC);
+
+	return min(goodix_hist_floor_us(i + 1),
+		   div_u64(st->max_ns, NSEC_PER_USEC));
+}
+
+/*
+ * Each stage carries its whole histogram, too big for the stack, so it
+ * is snapshotted one stage at a time into a heap buffer under the lock.
+ */
+static int goodix_timing_show(struct seq_file *m, void *v)
+{
+	struct goodix_ts_data *ts = m->private;
+	struct goodix_stage_stat *st;
+	unsigned long flags;
+	int i;
+
+	st = kmalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return -ENOMEM;
+
+	seq_printf(m, "%-8s %10s %8s %8s %8s %8s %8s\n", "stage", "count",
+		   "min_us", "avg_us", "p50_us", "p99_us", "max_us");
+	for (i = 0; i < GOODIX_STAGE_NUM; i++) {
+		spin_lock_irqsave(&ts->stat_lock, flags);
+		memcpy(st, &ts->stat[i], sizeof(*st));
+		spin_unlock_irqrestore(&ts->stat_lock, flags);
+
+		if (!st->count) {
+			seq_printf(m, "%-8s %10d\n", goodix_stage_names[i], 0);
+			continue;
+		}
+
+		seq_printf(m, "%-8s %10llu %8llu %8llu %8llu %8llu %8llu\n",
+			   goodix_stage_names[i], st->count,
+			   div_u64(st->min_ns, NSEC_PER_USEC),
+			   div_u64(div64_u64(st->sum_ns, st->count),
+				   NSEC_PER_USEC),
+			   goodix_hist_percentile(st, 50),
+			   goodix_hist_percentile(st, 99),
+			   div_u64(st->max_ns, NSEC_PER_USEC));
+	}
+	seq_printf(m, "not_ready_polls    %llu\n", ts->not_ready_polls);
+	seq_printf(m, "not_ready_timeouts %llu\n", ts->not_ready_timeouts);
+	seq_printf(m, "palm_rejected      %llu\n", ts->palm_rejected);
+	seq_printf(m, "frames_coalesced   %llu\n", ts->frames_coalesced);
+
+	kfree(st);
+	return 0;
+}
+
+static int goodix_timing_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, goodix_timing_show, inode->i_private);
+}
+
+/* Any write resets the counters, e.g. "echo 0 > timing" */
+static ssize_t goodix_timing_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct goodix_ts_data *ts = m->private;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ts->stat_lock, flags);
+	memset(ts->stat, 0, sizeof(ts->stat));
+	ts->not_ready_polls = 0;
+	ts->not_ready_timeouts = 0;
+	ts->palm_rejected = 0;
+	ts->frames_coalesced = 0;
+	spin_unlock_irqrestore(&ts->stat_lock, flags);
+
+	return count;
+}
+
+static const struct file_operations goodix_timing_fops = {
+	.owner = THIS_MODULE,
+	.open = goodix_timing_open,
+	.read = seq_read,
+	.write = goodix_timing_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* Raw buckets: "<stage> <floor_us> <count>" for every non-empty bucket */
+static int goodix_histogram_show(struct seq_file *m, void *v)
+{
+	struct goodix_ts_data *ts = m->private;
+	unsigned long flags;
+	u32 n;
+	int i, b;
+
+	for (i = 0; i < GOODIX_STAGE_NUM; i++) {
+		for (b = 0; b < GOODIX_HIST_BUCKETS; b++) {
+			spin_lock_irqsave(&ts->stat_lock, flags);
+			n = ts->stat[i].hist[b];
+			spin_unlock_irqrestore(&ts->stat_lock, flags);
+
+			if (n)
+				seq_printf(m, "%s %llu %u\n",
+					   goodix_stage_names[i],
+					   goodix_hist_floor_us(b), n);
+		}
+	}
+
+	return 0;
+}
+
+static int goodix_histogram_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, goodix_histogram_show, inode->i_private);
+}
+
+static const struct file_operations goodix_histogram_fops = {
+	.owner = THIS_MODULE,
+	.open = goodix_histogram_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void goodix_debugfs_remove(void *data)
+{
+	struct goodix_ts_data *ts = data;
+
+	debugfs_remove_recursive(ts->debugfs_dir);
+}
+
+/**
+ * goodix_debugfs_init - Create /sys/kernel/debug/gt911-<dev>/
+ *
+ * @ts: our goodix_ts_data pointer
+ *
+ * debugfs is optional, so failures here are not fatal to probe.
+ */
+static void goodix_debugfs_init(struct goodix_ts_data *ts)
+{
+	struct device *dev = &ts->client->dev;
+	char name[32];
+
+	snprintf(name, sizeof(name), "gt911-%s", dev_name(dev));
+	ts->debugfs_dir = debugfs_create_dir(name, NULL);
+	if (IS_ERR_OR_NULL(ts->debugfs_dir)) {
+		ts->debugfs_dir = NULL;
+		return;
+	}
+
+	debugfs_create_file("timing", S_IRUGO | S_IWUSR, ts->debugfs_dir,
+			    ts, &goodix_timing_fops);
+	debugfs_create_file("histogram", S_IRUGO, ts->debugfs_dir,
+			    ts, &goodix_histogram_fops);
+
+	if (devm_add_action(dev, goodix_debugfs_remove, ts)) {
+		debugfs_remove_recursive(ts->debugfs_dir);
+		ts->debugfs_dir = NULL;
+	}
+}
+
 /**
  * goodix_read_config - Read the embedded configuration of the panel
  *
@@ -305,10 +1131,10 @@ static irqreturn_t goodix_ts_irq_handler(int irq, void *dev_id)
  */
 static void goodix_read_config(struct goodix_ts_data *ts)
 {
-	u8 config[GOODIX_CONFIG_MAX_LENGTH];
+	u8 *config = ts->config;
 	int error;
 
-	error = goodix_i2c_read(ts->client, GOODIX_REG_CONFIG_DATA,
+	error = goodix_i2c_read(ts, GOODIX_REG_CONFIG_DATA,
 			      config,
 			   GOODIX_CONFIG_MAX_LENGTH);
 	if (error) {
@@ -318,9 +1144,10 @@ static void goodix_read_config(struct goodix_ts_data *ts)
 		ts->abs_x_max = GOODIX_MAX_WIDTH;
 		ts->abs_y_max = GOODIX_MAX_HEIGHT;
 		ts->int_trigger_type = GOODIX_INT_TRIGGER;
-		ts->max_touch_num = GOODIX_MAX_CONTACTS;
+		ts->max_touch_num = ts->chip->max_contacts;
 		return;
 	}
+	ts->config_valid = true;
 
 	#if 0
 	// print X Output Max
@@ -353,33 +1180,222 @@ static void goodix_read_config(struct goodix_ts_data *ts)
 	if (!ts->abs_x_max || !ts->abs_y_max || !ts->max_touch_num) {
 		dev_err(&ts->client->dev,
 			"Invalid config, using defaults\n");
+		ts->config_valid = false;
 		ts->abs_x_max = GOODIX_MAX_WIDTH;
 		ts->abs_y_max = GOODIX_MAX_HEIGHT;
-		ts->max_touch_num = GOODIX_MAX_CONTACTS;
+		ts->max_touch_num = ts->chip->max_contacts;
 	}
+	ts->max_touch_num = min(ts->max_touch_num, ts->chip->max_contacts);
+}
+
+/**
+ * goodix_send_cfg - Write a config block to the controller
+ *
+ * @ts: our goodix_ts_data pointer
+ * @cfg: chip->config_len bytes; the checksum and config-fresh
+ *       flag in the last two bytes are filled in here
+ *
+ * The controller only takes the block if the checksum (two's complement
+ * of the byte sum) matches and the fresh flag is set. It also ignores a
+ * config whose version byte is lower than the one it already runs.
+ * Caller holds cfg_lock.
+ */
+static int goodix_send_cfg(struct goodix_ts_data *ts, u8 *cfg)
+{
+	int len = ts->chip->config_len;
+	u8 check_sum = 0;
+	int error;
+	int i;
+
+	for (i = 0; i < len - 2; i++)
+		check_sum += cfg[i];
+	cfg[len - 2] = (~check_sum) + 1;
+	cfg[len - 1] = 1;
+
+	error = goodix_i2c_write(ts, GOODIX_REG_CONFIG_DATA, cfg, len);
+	if (error) {
+		dev_err(&ts->client->dev, "Failed to write config: %d\n",
+			error);
+		return error;
+	}
+
+	if (cfg != ts->config)
+		memcpy(ts->config, cfg, len);
+
+	return 0;
+}
+
+/**
+ * goodix_load_config_fw - Upload a config block from the firmware loader
+ *
+ * @ts: our goodix_ts_data pointer
+ *
+ * The file (DT "goodix,config-name", default goodix_<id>_cfg.bin) holds
+ * either the config bytes alone or the full block with checksum and
+ * fresh flag; those two are always recomputed. A missing file is not an error,
+ * the panel then keeps the config it booted with.
+ */
+static void goodix_load_config_fw(struct goodix_ts_data *ts)
+{
+	struct device *dev = &ts->client->dev;
+	int len = ts->chip->config_len;
+	const struct firmware *fw;
+	char fw_name[32];
+	const char *name = fw_name;
+	u8 cfg[GOODIX_CONFIG_MAX_LENGTH];
+	int error;
+
+	snprintf(fw_name, sizeof(fw_name), "goodix_%s_cfg.bin", ts->chip->id);
+	of_property_read_string(dev->of_node, "goodix,config-name", &name);
+
+	error = request_firmware_direct(&fw, name, dev);
+	if (error)
+		return;
+
+	if (fw->size != len && fw->size != len - 2) {
+		dev_err(dev, "%s: bad size %zu\n", name, fw->size);
+		goto out;
+	}
+
+	memcpy(cfg, fw->data, fw->size);
+
+	mutex_lock(&ts->cfg_lock);
+	error = goodix_send_cfg(ts, cfg);
+	mutex_unlock(&ts->cfg_lock);
+	if (!error) {
+		dev_info(dev, "config %s uploaded, version 0x%02x\n",
+			 name, cfg[0]);
+		/* let the controller apply it before we read it back */
+		msleep(100);
+	}
+
+out:
+	release_firmware(fw);
+}
+
+static unsigned int goodix_refresh_rate_hz(u8 reg)
+{
+	return 1000 / (GOODIX_REFRESH_BASE_MS +
+		       (reg & GOODIX_REFRESH_RATE_MASK));
+}
+
+static ssize_t goodix_report_rate_hz_show(struct device *dev,
+					  struct device_attribute *attr,
+					  char *buf)
+{
+	struct goodix_ts_data *ts = dev_get_drvdata(dev);
+	u8 reg;
+
+	/* the zeroed copy would decode as 200 Hz */
+	if (!ts->config_valid)
+		return -ENODATA;
+
+	mutex_lock(&ts->cfg_lock);
+	reg = ts->config[GOODIX_REG_REFRESH_RATE - GOODIX_REG_CONFIG_DATA];
+	mutex_unlock(&ts->cfg_lock);
+
+	return sprintf(buf, "%u\n", goodix_refresh_rate_hz(reg));
+}
+
+/*
+ * Rounds down to the nearest rate the controller supports, 200 Hz (5 ms)
+ * down to 50 Hz (20 ms), and rewrites the config with the new period.
+ * Refused when probe could not read a valid config, uploading the zeroed
+ * copy would wipe the panel setup.
+ */
+static ssize_t goodix_report_rate_hz_store(struct device *dev,
+					   struct device_attribute *attr,
+					   const char *buf, size_t count)
+{
+	struct goodix_ts_data *ts = dev_get_drvdata(dev);
+	u8 *reg = &ts->config[GOODIX_REG_REFRESH_RATE - GOODIX_REG_CONFIG_DATA];
+	unsigned int hz, period;
+	int error;
+
+	error = kstrtouint(buf, 0, &hz);
+	if (error)
+		return error;
+	if (!hz)
+		return -EINVAL;
+	if (!ts->config_valid)
+		return -ENODEV;
+
+	period = clamp_t(unsigned int, DIV_ROUND_UP(1000, hz),
+			 GOODIX_REFRESH_BASE_MS,
+			 GOODIX_REFRESH_BASE_MS + GOODIX_REFRESH_RATE_MASK);
+
+	mutex_lock(&ts->cfg_lock);
+	*reg = (*reg & ~GOODIX_REFRESH_RATE_MASK) |
+	       (period - GOODIX_REFRESH_BASE_MS);
+	error = goodix_send_cfg(ts, ts->config);
+	mutex_unlock(&ts->cfg_lock);
+
+	return error ? error : count;
+}
+
+static DEVICE_ATTR(report_rate_hz, S_IRUGO | S_IWUSR,
+		   goodix_report_rate_hz_show, goodix_report_rate_hz_store);
+
+static struct attribute *goodix_attrs[] = {
+	&dev_attr_report_rate_hz.attr,
+	NULL
+};
+
+static const struct attribute_group goodix_attr_group = {
+	.attrs = goodix_attrs,
+};
+
+static void goodix_sysfs_remove(void *data)
+{
+	struct goodix_ts_data *ts = data;
+
+	sysfs_remove_group(&ts->client->dev.kobj, &goodix_attr_group);
 }
 
 /**
  * goodix_read_version - Read goodix touchscreen version
  *
- * @client: the i2c client
- * @version: output buffer containing the version on success
+ * @ts: our goodix_ts_data pointer
+ *
+ * Fills ts->id and ts->version. If the product id names a different
+ * known chip than the compatible did, the id wins.
  */
-static int goodix_read_version(struct i2c_client *client, u16 *version)
+static int goodix_read_version(struct goodix_ts_data *ts)
 {
+	struct i2c_client *client = ts->client;
 	int error;
-	u8 buf[6];
+	int i;
+	u8 *buf;
+
+	buf = kmalloc(6, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
 
-	error = goodix_i2c_read(client, GOODIX_REG_VERSION, buf, sizeof(buf));
+	error = goodix_i2c_read(ts, GOODIX_REG_VERSION, buf, 6);
 	if (error) {
 		dev_err(&client->dev, "read version failed: %d\n", error);
+		kfree(buf);
 		return error;
 	}
 
-	if (version)
-		*version = get_unaligned_le16(&buf[4]);
+	memcpy(ts->id, buf, 4);
+	ts->id[4] = 0;
+	ts->version = get_unaligned_le16(&buf[4]);
 
 	dev_info(&client->dev, "IC VERSION: %6ph\n", buf);
+	kfree(buf);
+
+	if (!strcmp(ts->id, ts->chip->id))
+		return 0;
+
+	for (i = 0; i < ARRAY_SIZE(goodix_chips); i++) {
+		if (!strcmp(ts->id, goodix_chips[i]->id)) {
+			dev_warn(&client->dev, "GT%s found, DT says GT%s\n",
+				 ts->id, ts->chip->id);
+			ts->chip = goodix_chips[i];
+			break;
+		}
+	}
 
 	return 0;
 }
@@ -387,17 +1403,18 @@ static int goodix_read_version(struct i2c_client *client, u16 *version)
 /**
  * goodix_i2c_test - I2C test function to check if the device answers.
  *
- * @client: the i2c client
+ * @ts: our goodix_ts_data pointer
  */
-static int goodix_i2c_test(struct i2c_client *client)
+static int goodix_i2c_test(struct goodix_ts_data *ts)
 {
+	struct i2c_client *client = ts->client;
 	int retry = 0;
 	int error;
-	u8 test;
 
 	while (retry++ < 2) {
-		error = goodix_i2c_read(client, GOODIX_REG_CONFIG_DATA,
-					&test, 1);
+		/* one byte into the config copy, read_config refills it */
+		error = goodix_i2c_read(ts, GOODIX_REG_CONFIG_DATA,
+					ts->config, 1);
 		if (!error)
 			return 0;
 
@@ -409,6 +1426,50 @@ static int goodix_i2c_test(struct i2c_client *client)
 	return error;
 }
 
+/**
+ * goodix_parse_touch_props - Read the DT touchscreen-* properties
+ *
+ * @ts: our goodix_ts_data pointer
+ *
+ * Must be called after goodix_read_config(). touchscreen-size-x/y are
+ * in the swapped (display) orientation; raw coordinates are scaled
+ * from the controller resolution to that size. goodix,filter-shift and
+ * goodix,jitter-px enable the jitter filter; goodix,palm-width drops
+ * contacts at least that wide.
+ */
+static void goodix_parse_touch_props(struct goodix_ts_data *ts)
+{
+	struct device_node *np = ts->client->dev.of_node;
+	int res_x = ts->abs_x_max;
+	int res_y = ts->abs_y_max;
+	u32 size_x = 0, size_y = 0;
+
+	ts->swap_xy = of_property_read_bool(np, "touchscreen-swapped-x-y");
+	ts->invert_x = of_property_read_bool(np, "touchscreen-inverted-x");
+	ts->invert_y = of_property_read_bool(np, "touchscreen-inverted-y");
+	if (ts->swap_xy)
+		swap(res_x, res_y);
+
+	ts->out_x_max = res_x;
+	ts->out_y_max = res_y;
+
+	of_property_read_u32(np, "touchscreen-size-x", &size_x);
+	of_property_read_u32(np, "touchscreen-size-y", &size_y);
+	if (size_x && size_x != res_x) {
+		ts->scale_x = div_u64((u64)size_x << 16, res_x);
+		ts->out_x_max = size_x - 1;
+	}
+	if (size_y && size_y != res_y) {
+		ts->scale_y = div_u64((u64)size_y << 16, res_y);
+		ts->out_y_max = size_y - 1;
+	}
+
+	of_property_read_u32(np, "goodix,filter-shift", &ts->filter_shift);
+	of_property_read_u32(np, "goodix,jitter-px", &ts->jitter_px);
+	of_property_read_u32(np, "goodix,palm-width", &ts->palm_width);
+	ts->filter_shift = min_t(u32, ts->filter_shift, 7);
+}
+
 /**
  * goodix_request_input_dev - Allocate, populate and register the input device
  *
@@ -432,11 +1493,11 @@ static int goodix_request_input_dev(struct goodix_ts_data *ts)
 
 	__set_bit(BTN_TOUCH, ts->input_dev->keybit);
 
-	input_set_abs_params(ts->input_dev, ABS_X, 0, ts->abs_x_max, 0, 0);
-	input_set_abs_params(ts->input_dev, ABS_Y, 0, ts->abs_y_max, 0, 0);
+	input_set_abs_params(ts->input_dev, ABS_X, 0, ts->out_x_max, 0, 0);
+	input_set_abs_params(ts->input_dev, ABS_Y, 0, ts->out_y_max, 0, 0);
 
-	input_set_abs_params(ts->input_dev, ABS_MT_POSITION_X, 0, ts->abs_x_max, 0, 0);
-	input_set_abs_params(ts->input_dev, ABS_MT_POSITION_Y, 0, ts->abs_y_max, 0, 0);
+	input_set_abs_params(ts->input_dev, ABS_MT_POSITION_X, 0, ts->out_x_max, 0, 0);
+	input_set_abs_params(ts->input_dev, ABS_MT_POSITION_Y, 0, ts->out_y_max, 0, 0);
 	input_set_abs_params(ts->input_dev, ABS_MT_WIDTH_MAJOR, 0, 255, 0, 0);
 	input_set_abs_params(ts->input_dev, ABS_MT_TOUCH_MAJOR, 0, 255, 0, 0);
 
@@ -448,7 +1509,7 @@ static int goodix_request_input_dev(struct goodix_ts_data *ts)
 	ts->input_dev->id.bustype = BUS_I2C;
 	ts->input_dev->id.vendor = 0x0416;
 	ts->input_dev->id.product = 0x1001;
-	ts->input_dev->id.version = 10427;
+	ts->input_dev->id.version = ts->version;
 
 	error = input_register_device(ts->input_dev);
 	if (error) {
@@ -466,7 +1527,6 @@ static int goodix_ts_probe(struct i2c_client *client,
 	struct goodix_ts_data *ts;
 	unsigned long irq_flags;
 	int error;
-	u16 version_info;
 
 	dev_dbg(&client->dev, "I2C Address: 0x%02x\n", client->addr);
 
@@ -481,8 +1541,25 @@ static int goodix_ts_probe(struct i2c_client *client,
 
 
 	ts->client = client;
+	ts->chip = &gt911_chip_data;
+	if (client->dev.of_node) {
+		const struct of_device_id *match;
+
+		match = of_match_device(goodix_of_match, &client->dev);
+		if (match && match->data)
+			ts->chip = match->data;
+	} else if (id && id->driver_data) {
+		ts->chip = (const struct goodix_chip_data *)id->driver_data;
+	}
+	spin_lock_init(&ts->stat_lock);
+	mutex_init(&ts->wbuf_lock);
+	mutex_init(&ts->cfg_lock);
 	i2c_set_clientdata(client, ts);
 
+	ts->wbuf = devm_kzalloc(&client->dev, GOODIX_WBUF_SIZE, GFP_KERNEL);
+	if (!ts->wbuf)
+		return -ENOMEM;
+
 	// get reset/int gpio
 	ts->reset_gpio = of_get_named_gpio(client->dev.of_node, "reset-gpios", 0);
 	ts->irq_gpio = of_get_named_gpio(client->dev.of_node, "irq-gpios", 0);
@@ -492,21 +1569,30 @@ static int goodix_ts_probe(struct i2c_client *client,
 	goodix_reset(ts);
 
 	// init
-	goodix_sw_reset(ts->client);
+	goodix_sw_reset(ts);
 
-	// error = goodix_i2c_test(client);
+	// error = goodix_i2c_test(ts);
 	// if (error) {
 	// 	dev_err(&client->dev, "I2C communication failure: %d\n", error);
 	// 	return error;
 	// }
 
-	error = goodix_read_version(client, &version_info);
+	error = goodix_read_version(ts);
 	if (error) {
 		dev_err(&client->dev, "Read version failed.\n");
 		return error;
 	}
 
+	goodix_load_config_fw(ts);
 	goodix_read_config(ts);
+	goodix_parse_touch_props(ts);
+
+	/* sized from the panel config, one status byte + all contacts */
+	ts->point_data = devm_kzalloc(&client->dev,
+				      1 + GOODIX_CONTACT_SIZE * ts->max_touch_num,
+				      GFP_KERNEL);
+	if (!ts->point_data)
+		return -ENOMEM;
 
 	error = goodix_request_input_dev(ts);
 	if (error)
@@ -518,21 +1604,42 @@ static int goodix_ts_probe(struct i2c_client *client,
 	dev_info(&client->dev, "irq_flags: 0x%08lx\n", irq_flags);
 	dev_info(&client->dev, "irq_num: %d\n", client->irq);
 
+	goodix_debugfs_init(ts);
+
+	error = sysfs_create_group(&client->dev.kobj, &goodix_attr_group);
+	if (error)
+		return error;
+	error = devm_add_action(&client->dev, goodix_sysfs_remove, ts);
+	if (error) {
+		goodix_sysfs_remove(ts);
+		return error;
+	}
+
+	if (polling || client->irq <= 0 ||
+	    of_property_read_bool(client->dev.of_node, "goodix,polling-mode"))
+		return goodix_poll_start(ts);
+
 	error = devm_request_threaded_irq(&ts->client->dev, client->irq,
-					  NULL, goodix_ts_irq_handler,
+					  goodix_ts_irq_hard, goodix_ts_irq_handler,
 					  irq_flags, client->name, ts);
 	if (error) {
-		dev_err(&client->dev, "request IRQ failed: %d\n", error);
-		return error;
+		/* shared or unusable INT line, keep working without it */
+		dev_warn(&client->dev, "request IRQ failed: %d, polling\n",
+			 error);
+		return goodix_poll_start(ts);
 	}
 
 	return 0;
 }
 
 static const struct i2c_device_id goodix_ts_id[] = {
-	{ "GDIX1001:00", 0 },
+	{ "GDIX1001:00", (kernel_ulong_t)&gt911_chip_data },
+	{ "gt911", (kernel_ulong_t)&gt911_chip_data },
+	{ "gt9147", (kernel_ulong_t)&gt9147_chip_data },
+	{ "gt928", (kernel_ulong_t)&gt928_chip_data },
 	{ }
 };
+MODULE_DEVICE_TABLE(i2c, goodix_ts_id);
 
 #ifdef CONFIG_ACPI
 static const struct acpi_device_id goodix_acpi_match[] = {
@@ -542,16 +1649,21 @@ static const struct acpi_device_id goodix_acpi_match[] = {
 MODULE_DEVICE_TABLE(acpi, goodix_acpi_match);
 #endif
 
-#ifdef CONFIG_OF
-static const struct of_device_id goodix_of_match[] = {
-	{ .compatible = "goodix,gt911" },
-	{ }
-};
-MODULE_DEVICE_TABLE(of, goodix_of_match);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+/* 6.3 dropped the i2c_device_id argument from probe */
+static int goodix_ts_probe_new(struct i2c_client *client)
+{
+	return goodix_ts_probe(client, i2c_client_get_device_id(client));
+}
 #endif
 
 static struct i2c_driver goodix_ts_driver = {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	.probe = goodix_ts_probe_new,
+#else
 	.probe = goodix_ts_probe,
+#endif
 	.id_table = goodix_ts_id,
 	.driver = {
 		.name = "gt911",
@@ -565,5 +1677,5 @@ module_i2c_driver(goodix_ts_driver);
 MODULE_AUTHOR("Benjamin Tissoires <benjamin.tissoires@gmail.com>");
 MODULE_AUTHOR("Bastien Nocera <hadess@hadess.net>");
 MODULE_AUTHOR("Alvin <yuanye0814@gmail.com>");
-MODULE_DESCRIPTION("gt911 touchscreen driver");
+MODULE_DESCRIPTION("Goodix GT9xx touchscreen driver");
 MODULE_LICENSE("GPL v2");
@@ -0,0 +1,437 @@
+/*
+ * Touch replay and benchmark harness for gt911.ko on top of gt911_sim.ko
+ *
+ *   gt911_replay_app -r <gesture.txt> [-e /dev/input/eventN]
+ *       record a gesture from a real panel (Ctrl+C to stop)
+ *   gt911_replay_app -p <gesture.txt> [-n repeat] [-e /dev/input/eventN]
+ *       replay a recorded gesture through /dev/gt911_sim
+ *   gt911_replay_app -s <frames> [-i interval_us] [-e /dev/input/eventN]
+ *       replay a synthetic two-finger swipe
+ *
+ * Gesture files have one frame per line:
+ *   <delay_us> <touch_num> [<id> <x> <y> <w>] ...
+ *
+ * Replay reports the evdev event rate and the latency from each emulated
+ * INT (latch timestamp from the simulator) to the SYN_REPORT that
+ * carried it, both on CLOCK_MONOTONIC.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "gt911_sim.h"
+
+#define EVDEV_NAME      "Goodix Capacitive TouchScreen"
+#define MAX_SLOTS       16
+#define IDLE_MS         500     /* stop once nothing arrives for this long */
+
+static volatile sig_atomic_t stop;
+
+static void sigint_handler(int sig)
+{
+    stop = 1;
+}
+
+static uint64_t tv_to_ns(const struct timeval *tv)
+{
+    return (uint64_t)tv->tv_sec * 1000000000ull + tv->tv_usec * 1000ull;
+}
+
+/* Find the gt911 evdev node by name */
+static int open_evdev(const char *path)
+{
+    char name[256], node[300];
+    struct dirent *de;
+    DIR *dir;
+    int fd;
+
+    if (path)
+        return open(path, O_RDONLY | O_NONBLOCK);
+
+    dir = opendir("/dev/input");
+    if (!dir)
+        return -1;
+
+    while ((de = readdir(dir)) != NULL) {
+        if (strncmp(de->d_name, "event", 5))
+            continue;
+        snprintf(node, sizeof(node), "/dev/input/%s", de->d_name);
+        fd = open(node, O_RDONLY | O_NONBLOCK);
+        if (fd < 0)
+            continue;
+        if (ioctl(fd, EVIOCGNAME(sizeof(name)), name) > 0 &&
+            !strcmp(name, EVDEV_NAME)) {
+            printf("using %s\n", node);
+            closedir(dir);
+            return fd;
+        }
+        close(fd);
+    }
+
+    closedir(dir);
+    errno = ENODEV;
+    return -1;
+}
+
+static int load_gesture(const char *file, struct gt911_sim_frame **out)
+{
+    struct gt911_sim_frame *frames = NULL, *f;
+    int count = 0, cap = 0;
+    char line[512];
+    FILE *fp;
+
+    fp = fopen(file, "r");
+    if (!fp) {
+        perror(file);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = line;
+        int n, used, i;
+        unsigned int delay, tn;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(p, "%u %u%n", &delay, &tn, &used) != 2)
+            continue;
+        p += used;
+
+        if (count == cap) {
+            cap = cap ? cap * 2 : 256;
+            frames = realloc(frames, cap * sizeof(*frames));
+            if (!frames) {
+                fclose(fp);
+                return -1;
+            }
+        }
+
+        f = &frames[count++];
+        memset(f, 0, sizeof(*f));
+        f->delay_us = delay;
+        f->touch_num = tn > GT911_SIM_MAX_POINTS ? GT911_SIM_MAX_POINTS : tn;
+        for (i = 0; i < f->touch_num; i++) {
+            unsigned int id, x, y, w;
+
+            n = sscanf(p, "%u %u %u %u%n", &id, &x, &y, &w, &used);
+            if (n != 4)
+                break;
+            p += used;
+            f->pts[i].id = id;
+            f->pts[i].x = x;
+            f->pts[i].y = y;
+            f->pts[i].w = w;
+        }
+        f->touch_num = i;
+    }
+
+    fclose(fp);
+    *out = frames;
+    return count;
+}
+
+/* Two fingers swiping left to right, then a release frame */
+static int make_swipe(int count, unsigned int interval_us,
+                      struct gt911_sim_frame **out)
+{
+    struct gt911_sim_frame *frames;
+    int i;
+
+    frames = calloc(count + 1, sizeof(*frames));
+    if (!frames)
+        return -1;
+
+    for (i = 0; i < count; i++) {
+        frames[i].delay_us = interval_us;
+        frames[i].touch_num = 2;
+        frames[i].pts[0].id = 0;
+        frames[i].pts[0].x = 50 + (i * 900 / count);
+        frames[i].pts[0].y = 200;
+        frames[i].pts[0].w = 20;
+        frames[i].pts[1].id = 1;
+        frames[i].pts[1].x = 50 + (i * 900 / count);
+        frames[i].pts[1].y = 400;
+        frames[i].pts[1].w = 20;
+    }
+    frames[count].delay_us = interval_us;
+
+    *out = frames;
+    return count + 1;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int record(const char *file, const char *evdev)
+{
+    struct { int id, x, y, w; } slot[MAX_SLOTS];
+    struct input_event ev;
+    struct pollfd pfd;
+    uint64_t last_ns = 0;
+    int cur = 0, frames = 0, i, n;
+    FILE *fp;
+
+    pfd.fd = open_evdev(evdev);
+    if (pfd.fd < 0) {
+        perror("open evdev");
+        return 1;
+    }
+    pfd.events = POLLIN;
+
+    fp = fopen(file, "w");
+    if (!fp) {
+        perror(file);
+        return 1;
+    }
+
+    for (i = 0; i < MAX_SLOTS; i++)
+        slot[i].id = -1;
+
+    fprintf(fp, "# delay_us touch_num [id x y w]...\n");
+    printf("recording to %s, Ctrl+C to stop\n", file);
+
+    while (!stop) {
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+
+        while (read(pfd.fd, &ev, sizeof(ev)) == sizeof(ev)) {
+            if (ev.type == EV_ABS) {
+                switch (ev.code) {
+                case ABS_MT_SLOT:
+                    cur = ev.value < MAX_SLOTS ? ev.value : 0;
+                    break;
+                case ABS_MT_TRACKING_ID:
+                    slot[cur].id = ev.value;
+                    break;
+                case ABS_MT_POSITION_X:
+                    slot[cur].x = ev.value;
+                    break;
+                case ABS_MT_POSITION_Y:
+                    slot[cur].y = ev.value;
+                    break;
+                case ABS_MT_TOUCH_MAJOR:
+                    slot[cur].w = ev.value;
+                    break;
+                }
+            } else if (ev.type == EV_SYN && ev.code == SYN_REPORT) {
+                uint64_t now = tv_to_ns(&ev.time);
+
+                for (i = 0, n = 0; i < MAX_SLOTS; i++)
+                    n += slot[i].id >= 0;
+
+                fprintf(fp, "%llu %d",
+                        last_ns ? (unsigned long long)(now - last_ns) / 1000 : 0ull,
+                        n);
+                for (i = 0; i < MAX_SLOTS; i++) {
+                    if (slot[i].id >= 0)
+                        fprintf(fp, " %d %d %d %d", slot[i].id & 0x0f,
+                                slot[i].x, slot[i].y, slot[i].w);
+                }
+                fprintf(fp, "\n");
+                last_ns = now;
+                frames++;
+            }
+        }
+    }
+
+    printf("\n%d frames recorded\n", frames);
+    fclose(fp);
+    close(pfd.fd);
+    return 0;
+}
+
+static int replay(struct gt911_sim_frame *frames, int count, int repeat,
+                  const char *evdev)
+{
+    int total = count * repeat;
+    uint64_t *stamps, *syns, *lat;
+    unsigned long long events = 0;
+    int nstamps = 0, nsyns = 0, nlat = 0, sent = 0;
+    struct gt911_sim_stamp st[64];
+    struct input_event ev[64];
+    struct pollfd pfd[2];
+    uint64_t sum = 0, first = 0, last = 0;
+    int clk = CLOCK_MONOTONIC;
+    int simfd, evfd, i, j, n;
+
+    stamps = calloc(total, sizeof(*stamps));
+    syns = calloc(total * 2, sizeof(*syns));
+    lat = calloc(total * 2, sizeof(*lat));
+    if (!stamps || !syns || !lat)
+        return 1;
+
+    simfd = open("/dev/" GT911_SIM_DEV_NAME, O_RDWR | O_NONBLOCK);
+    if (simfd < 0) {
+        perror("open /dev/" GT911_SIM_DEV_NAME);
+        return 1;
+    }
+
+    evfd = open_evdev(evdev);
+    if (evfd < 0) {
+        perror("open evdev");
+        return 1;
+    }
+    if (ioctl(evfd, EVIOCSCLOCKID, &clk))
+        perror("EVIOCSCLOCKID");
+
+    /* drop whatever was left in the fifo by an earlier run */
+    while (read(simfd, st, sizeof(st)) > 0)
+        ;
+
+    pfd[0].fd = simfd;
+    pfd[1].fd = evfd;
+    pfd[1].events = POLLIN;
+
+    printf("replaying %d frames\n", total);
+
+    while (!stop) {
+        pfd[0].events = POLLIN | (sent < total ? POLLOUT : 0);
+        n = poll(pfd, 2, IDLE_MS);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0 && sent == total)
+            break;
+
+        if (pfd[0].revents & POLLOUT) {
+            int idx = sent % count;
+            int chunk = count - idx;
+
+            if (chunk > total - sent)
+                chunk = total - sent;
+            n = write(simfd, &frames[idx], chunk * sizeof(*frames));
+            if (n > 0)
+                sent += n / sizeof(*frames);
+        }
+
+        if (pfd[0].revents & POLLIN) {
+            n = read(simfd, st, sizeof(st));
+            for (i = 0; i < n / (int)sizeof(st[0]) && nstamps < total; i++)
+                stamps[nstamps++] = st[i].latch_ns;
+        }
+
+        if (pfd[1].revents & POLLIN) {
+            n = read(evfd, ev, sizeof(ev));
+            for (i = 0; i < n / (int)sizeof(ev[0]); i++) {
+                events++;
+                if (ev[i].type == EV_SYN && ev[i].code == SYN_REPORT &&
+                    nsyns < total * 2)
+                    syns[nsyns++] = tv_to_ns(&ev[i].time);
+            }
+        }
+    }
+
+    /*
+     * The simulator only latches a frame after the driver acked the
+     * previous one, so a SYN_REPORT belongs to the latest latch before it.
+     */
+    for (i = 0, j = 0; i < nsyns; i++) {
+        while (j + 1 < nstamps && stamps[j + 1] <= syns[i])
+            j++;
+        if (j < nstamps && stamps[j] <= syns[i])
+            lat[nlat++] = syns[i] - stamps[j];
+    }
+
+    if (nstamps) {
+        first = stamps[0];
+        last = nsyns ? syns[nsyns - 1] : stamps[nstamps - 1];
+    }
+
+    printf("frames latched  %d/%d\n", nstamps, total);
+    printf("evdev events    %llu (%d SYN_REPORT)\n", events, nsyns);
+    if (last > first)
+        printf("events/s        %.0f\n", events * 1e9 / (last - first));
+
+    if (nlat) {
+        qsort(lat, nlat, sizeof(*lat), cmp_u64);
+        for (i = 0; i < nlat; i++)
+            sum += lat[i];
+        printf("INT->evdev us   min %.1f avg %.1f p50 %.1f p99 %.1f max %.1f\n",
+               lat[0] / 1e3, sum / 1e3 / nlat, lat[nlat / 2] / 1e3,
+               lat[(nlat * 99) / 100] / 1e3, lat[nlat - 1] / 1e3);
+    }
+
+    close(evfd);
+    close(simfd);
+    free(stamps);
+    free(syns);
+    free(lat);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s -r <gesture.txt> [-e evdev]\n", prog);
+    printf("       %s -p <gesture.txt> [-n repeat] [-e evdev]\n", prog);
+    printf("       %s -s <frames> [-i interval_us] [-e evdev]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    struct gt911_sim_frame *frames = NULL;
+    const char *evdev = NULL, *file = NULL;
+    unsigned int interval_us = 10000;
+    int mode = 0, repeat = 1, synth = 0, count, ret, opt;
+
+    while ((opt = getopt(argc, argv, "r:p:s:e:n:i:")) != -1) {
+        switch (opt) {
+        case 'r':
+        case 'p':
+            mode = opt;
+            file = optarg;
+            break;
+        case 's':
+            mode = opt;
+            synth = atoi(optarg);
+            break;
+        case 'e':
+            evdev = optarg;
+            break;
+        case 'n':
+            repeat = atoi(optarg);
+            break;
+        case 'i':
+            interval_us = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!mode || repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGINT, sigint_handler);
+
+    if (mode == 'r')
+        return record(file, evdev);
+
+    if (mode == 'p')
+        count = load_gesture(file, &frames);
+    else
+        count = make_swipe(synth > 0 ? synth : 100, interval_us, &frames);
+    if (count <= 0) {
+        printf("no frames\n");
+        return 1;
+    }
+
+    ret = replay(frames, count, repeat, evdev);
+    free(frames);
+    return ret;
+}
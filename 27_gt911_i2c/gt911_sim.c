@@ -0,0 +1,490 @@
+/*
+ * Simulated GT911 touch controller
+ *
+ * Registers an i2c adapter whose only slave (0x14) answers like a GT911:
+ * product id/version at 0x8140, a config block at 0x8047 and the
+ * coordinate buffer at 0x814E with its buffer-ready bit. A gt911 client
+ * is instantiated on it, so the real gt911.ko binds and can be exercised
+ * without a panel, on the board or on a PC.
+ *
+ * Frames written to /dev/gt911_sim are latched into 0x814E one at a
+ * time, each delay_us after the previous one and only once the driver
+ * has acked the previous frame by clearing the status. Every latch
+ * fires an emulated INT (a software irq handled from the latch hrtimer)
+ * and queues a timestamp that can be read back from /dev/gt911_sim.
+ *
+ * See gt911_sim.h for the record formats and gt911_replay_app.c for
+ * the userspace side.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/version.h>
+#include <linux/i2c.h>
+#include <linux/irq.h>
+#include <linux/irqdesc.h>
+#include <linux/interrupt.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/delay.h>
+#include <linux/kfifo.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 12, 0)
+#include <linux/unaligned.h>
+#else
+#include <asm/unaligned.h>
+#endif
+
+#include "gt911_sim.h"
+
+#define SIM_I2C_ADDR		0x14
+
+/* 0x8040 - 0x81FF covers everything gt911.c touches */
+#define SIM_REG_BASE		0x8040
+#define SIM_REG_SIZE		0x1C0
+#define SIM_REG_CONFIG		0x8047
+#define SIM_REG_REFRESH_RATE	0x8056
+#define SIM_REG_CONFIG_CHKSUM	0x80FF
+#define SIM_REG_CONFIG_FRESH	0x8100
+#define SIM_REG_VERSION		0x8140
+#define SIM_REG_COOR		0x814E
+
+#define SIM_STATUS_READY	0x80
+#define SIM_CONTACT_SIZE	8
+
+#define SIM_X_RES		1024
+#define SIM_Y_RES		600
+#define SIM_MAX_CONTACTS	5
+
+#define SIM_FIFO_FRAMES		256
+#define SIM_FIFO_STAMPS		1024
+#define SIM_STALL_RETRY_US	100	/* re-check period while un-acked */
+
+static unsigned int bus_khz;
+module_param(bus_khz, uint, 0644);
+MODULE_PARM_DESC(bus_khz, "Emulated I2C clock for transfer time, 0 = instant");
+
+struct gt911_sim_dev {
+	struct i2c_adapter adap;
+	struct i2c_client *client;
+	struct miscdevice misc;
+	int irq;
+
+	spinlock_t lock;			/* regs, running */
+	u8 regs[SIM_REG_SIZE];
+	bool running;				/* latch timer armed */
+	bool stopping;
+
+	struct mutex write_lock;		/* single frames producer */
+	DECLARE_KFIFO(frames, struct gt911_sim_frame, SIM_FIFO_FRAMES);
+	wait_queue_head_t frame_wait;
+
+	DECLARE_KFIFO(stamps, struct gt911_sim_stamp, SIM_FIFO_STAMPS);
+	wait_queue_head_t stamp_wait;
+
+	struct hrtimer timer;
+	u32 seq;
+	u32 stalls;
+	u32 config_writes;
+};
+
+static struct gt911_sim_dev gt911_sim;
+
+static u8 *sim_reg(u16 reg)
+{
+	if (reg < SIM_REG_BASE || reg >= SIM_REG_BASE + SIM_REG_SIZE)
+		return NULL;
+
+	return &gt911_sim.regs[reg - SIM_REG_BASE];
+}
+
+/* Power-on register contents: GT911, 1024x600, 5 points, falling INT */
+static void sim_reset_regs(void)
+{
+	u8 *cfg = sim_reg(SIM_REG_CONFIG);
+	u8 sum = 0;
+	u16 reg;
+
+	memset(gt911_sim.regs, 0, sizeof(gt911_sim.regs));
+
+	memcpy(sim_reg(SIM_REG_VERSION), "911", 4);
+	put_unaligned_le16(0x1060, sim_reg(SIM_REG_VERSION + 4));
+
+	cfg[0] = 0x41;				/* config version */
+	put_unaligned_le16(SIM_X_RES, &cfg[1]);
+	put_unaligned_le16(SIM_Y_RES, &cfg[3]);
+	cfg[5] = SIM_MAX_CONTACTS;
+	cfg[6] = 0x01;				/* falling edge */
+	*sim_reg(SIM_REG_REFRESH_RATE) = 0x05;	/* (5 + 5) ms */
+
+	for (reg = SIM_REG_CONFIG; reg < SIM_REG_CONFIG_CHKSUM; reg++)
+		sum += *sim_reg(reg);
+	*sim_reg(SIM_REG_CONFIG_CHKSUM) = (~sum) + 1;
+}
+
+static void sim_write_regs(u16 reg, const u8 *buf, int len)
+{
+	unsigned long flags;
+	u8 *p;
+	int i;
+
+	spin_lock_irqsave(&gt911_sim.lock, flags);
+	for (i = 0; i < len; i++) {
+		p = sim_reg(reg + i);
+		if (p)
+			*p = buf[i];
+	}
+
+	/* the controller consumes a fresh config and drops the flag */
+	p = sim_reg(SIM_REG_CONFIG_FRESH);
+	if (reg <= SIM_REG_CONFIG_FRESH && reg + len > SIM_REG_CONFIG_FRESH &&
+	    *p) {
+		*p = 0;
+		gt911_sim.config_writes++;
+	}
+	spin_unlock_irqrestore(&gt911_sim.lock, flags);
+}
+
+static void sim_read_regs(u16 reg, u8 *buf, int len)
+{
+	unsigned long flags;
+	u8 *p;
+	int i;
+
+	spin_lock_irqsave(&gt911_sim.lock, flags);
+	for (i = 0; i < len; i++) {
+		p = sim_reg(reg + i);
+		buf[i] = p ? *p : 0;
+	}
+	spin_unlock_irqrestore(&gt911_sim.lock, flags);
+}
+
+/*
+ * Writes start with the 16-bit register address; a following read
+ * message continues from there, like the real controller.
+ */
+static int sim_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	unsigned int bytes = 0;
+	u16 ptr = 0;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		struct i2c_msg *msg = &msgs[i];
+
+		if (msg->addr != SIM_I2C_ADDR)
+			return -ENXIO;
+
+		if (msg->flags & I2C_M_RD) {
+			sim_read_regs(ptr, msg->buf, msg->len);
+			ptr += msg->len;
+		} else {
+			if (msg->len < 2)
+				return -EIO;
+			ptr = (msg->buf[0] << 8) | msg->buf[1];
+			sim_write_regs(ptr, &msg->buf[2], msg->len - 2);
+			ptr += msg->len - 2;
+		}
+		bytes += 1 + msg->len;
+	}
+
+	/* 9 clocks per byte incl. ACK */
+	if (bus_khz) {
+		unsigned long us = bytes * 9 * 1000 / bus_khz;
+
+		usleep_range(us, us + us / 8 + 1);
+	}
+
+	return num;
+}
+
+static u32 sim_func(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C;
+}
+
+static const struct i2c_algorithm sim_algo = {
+	.master_xfer = sim_xfer,
+	.functionality = sim_func,
+};
+
+/* Copy one frame into the coordinate buffer, caller holds the lock */
+static void sim_latch(const struct gt911_sim_frame *f)
+{
+	u8 *status = sim_reg(SIM_REG_COOR);
+	int n = min_t(int, f->touch_num, SIM_MAX_CONTACTS);
+	int i;
+
+	for (i = 0; i < n; i++) {
+		u8 *p = status + 1 + SIM_CONTACT_SIZE * i;
+
+		p[0] = f->pts[i].id & 0x0f;
+		put_unaligned_le16(f->pts[i].x, &p[1]);
+		put_unaligned_le16(f->pts[i].y, &p[3]);
+		put_unaligned_le16(f->pts[i].w, &p[5]);
+		p[7] = 0;
+	}
+	*status = SIM_STATUS_READY | n;
+}
+
+static enum hrtimer_restart sim_timer_fn(struct hrtimer *timer)
+{
+	struct gt911_sim_frame f;
+	struct gt911_sim_stamp st;
+	u32 next_us = 0;
+	bool more;
+
+	spin_lock(&gt911_sim.lock);
+	if (gt911_sim.stopping) {
+		gt911_sim.running = false;
+		spin_unlock(&gt911_sim.lock);
+		return HRTIMER_NORESTART;
+	}
+
+	/* the driver has not cleared the last frame yet */
+	if (*sim_reg(SIM_REG_COOR) & SIM_STATUS_READY) {
+		gt911_sim.stalls++;
+		spin_unlock(&gt911_sim.lock);
+		hrtimer_forward_now(timer,
+				    ns_to_ktime(SIM_STALL_RETRY_US * NSEC_PER_USEC));
+		return HRTIMER_RESTART;
+	}
+
+	if (!kfifo_get(&gt911_sim.frames, &f)) {
+		gt911_sim.running = false;
+		spin_unlock(&gt911_sim.lock);
+		return HRTIMER_NORESTART;
+	}
+
+	sim_latch(&f);
+	st.seq = gt911_sim.seq++;
+	st.stalls = gt911_sim.stalls;
+	st.latch_ns = ktime_get_ns();
+	kfifo_put(&gt911_sim.stamps, st);
+
+	more = kfifo_peek(&gt911_sim.frames, &f);
+	if (more)
+		next_us = f.delay_us;
+	else
+		gt911_sim.running = false;
+	spin_unlock(&gt911_sim.lock);
+
+	/* INT asserted */
+	generic_handle_irq(gt911_sim.irq);
+
+	wake_up_interruptible(&gt911_sim.stamp_wait);
+	wake_up_interruptible(&gt911_sim.frame_wait);
+
+	if (!more)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, ns_to_ktime((u64)next_us * NSEC_PER_USEC));
+	return HRTIMER_RESTART;
+}
+
+/* Arm the latch timer for the head frame if it is not running yet */
+static void sim_kick(void)
+{
+	struct gt911_sim_frame f;
+	unsigned long flags;
+
+	spin_lock_irqsave(&gt911_sim.lock, flags);
+	if (!gt911_sim.running && !gt911_sim.stopping &&
+	    kfifo_peek(&gt911_sim.frames, &f)) {
+		gt911_sim.running = true;
+		hrtimer_start(&gt911_sim.timer,
+			      ns_to_ktime((u64)f.delay_us * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL);
+	}
+	spin_unlock_irqrestore(&gt911_sim.lock, flags);
+}
+
+static ssize_t sim_write(struct file *filp, const char __user *buf,
+			 size_t cnt, loff_t *off)
+{
+	unsigned int copied;
+	size_t len = rounddown(cnt, sizeof(struct gt911_sim_frame));
+	int ret;
+
+	if (!len)
+		return -EINVAL;
+
+	if (mutex_lock_interruptible(&gt911_sim.write_lock))
+		return -ERESTARTSYS;
+
+	if (kfifo_is_full(&gt911_sim.frames)) {
+		mutex_unlock(&gt911_sim.write_lock);
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(gt911_sim.frame_wait,
+					       !kfifo_is_full(&gt911_sim.frames));
+		if (ret)
+			return ret;
+		if (mutex_lock_interruptible(&gt911_sim.write_lock))
+			return -ERESTARTSYS;
+	}
+
+	ret = kfifo_from_user(&gt911_sim.frames, buf, len, &copied);
+	mutex_unlock(&gt911_sim.write_lock);
+	if (ret)
+		return ret;
+
+	sim_kick();
+
+	return copied;
+}
+
+static ssize_t sim_read(struct file *filp, char __user *buf,
+			size_t cnt, loff_t *off)
+{
+	unsigned int copied;
+	size_t len = rounddown(cnt, sizeof(struct gt911_sim_stamp));
+	int ret;
+
+	if (!len)
+		return -EINVAL;
+
+	if (kfifo_is_empty(&gt911_sim.stamps)) {
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(gt911_sim.stamp_wait,
+					!kfifo_is_empty(&gt911_sim.stamps));
+		if (ret)
+			return ret;
+	}
+
+	ret = kfifo_to_user(&gt911_sim.stamps, buf, len, &copied);
+
+	return ret ? ret : copied;
+}
+
+static unsigned int sim_poll(struct file *filp, struct poll_table_struct *wait)
+{
+	unsigned int mask = 0;
+
+	poll_wait(filp, &gt911_sim.stamp_wait, wait);
+	poll_wait(filp, &gt911_sim.frame_wait, wait);
+
+	if (!kfifo_is_empty(&gt911_sim.stamps))
+		mask |= POLLIN | POLLRDNORM;
+	if (!kfifo_is_full(&gt911_sim.frames))
+		mask |= POLLOUT | POLLWRNORM;
+
+	return mask;
+}
+
+static const struct file_operations sim_fops = {
+	.owner = THIS_MODULE,
+	.read = sim_read,
+	.write = sim_write,
+	.poll = sim_poll,
+	.llseek = noop_llseek,
+};
+
+static int __init gt911_sim_init(void)
+{
+	struct i2c_board_info info = {
+		I2C_BOARD_INFO("gt911", SIM_I2C_ADDR),
+	};
+	int ret;
+
+	spin_lock_init(&gt911_sim.lock);
+	mutex_init(&gt911_sim.write_lock);
+	INIT_KFIFO(gt911_sim.frames);
+	INIT_KFIFO(gt911_sim.stamps);
+	init_waitqueue_head(&gt911_sim.frame_wait);
+	init_waitqueue_head(&gt911_sim.stamp_wait);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup(&gt911_sim.timer, sim_timer_fn, CLOCK_MONOTONIC,
+		      HRTIMER_MODE_REL);
+#else
+	hrtimer_init(&gt911_sim.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	gt911_sim.timer.function = sim_timer_fn;
+#endif
+	sim_reset_regs();
+
+	/* INT line: a software irq, requestable by the gt911 driver */
+	gt911_sim.irq = irq_alloc_desc(0);
+	if (gt911_sim.irq < 0)
+		return gt911_sim.irq;
+	irq_set_chip_and_handler(gt911_sim.irq, &dummy_irq_chip,
+				 handle_simple_irq);
+	irq_modify_status(gt911_sim.irq, IRQ_NOREQUEST | IRQ_NOAUTOEN,
+			  IRQ_NOPROBE);
+
+	gt911_sim.adap.owner = THIS_MODULE;
+	gt911_sim.adap.algo = &sim_algo;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 3, 0)
+	strscpy(gt911_sim.adap.name, "gt911-sim", sizeof(gt911_sim.adap.name));
+#else
+	strlcpy(gt911_sim.adap.name, "gt911-sim", sizeof(gt911_sim.adap.name));
+#endif
+	ret = i2c_add_adapter(&gt911_sim.adap);
+	if (ret)
+		goto free_irq;
+
+	info.irq = gt911_sim.irq;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
+	gt911_sim.client = i2c_new_client_device(&gt911_sim.adap, &info);
+	if (IS_ERR(gt911_sim.client)) {
+		ret = PTR_ERR(gt911_sim.client);
+		goto del_adapter;
+	}
+#else
+	gt911_sim.client = i2c_new_device(&gt911_sim.adap, &info);
+	if (!gt911_sim.client) {
+		ret = -ENODEV;
+		goto del_adapter;
+	}
+#endif
+
+	gt911_sim.misc.minor = MISC_DYNAMIC_MINOR;
+	gt911_sim.misc.name = GT911_SIM_DEV_NAME;
+	gt911_sim.misc.fops = &sim_fops;
+	ret = misc_register(&gt911_sim.misc);
+	if (ret)
+		goto unregister_client;
+
+	printk("gt911_sim: adapter %d, irq %d\r\n",
+	       i2c_adapter_id(&gt911_sim.adap), gt911_sim.irq);
+	return 0;
+
+unregister_client:
+	i2c_unregister_device(gt911_sim.client);
+del_adapter:
+	i2c_del_adapter(&gt911_sim.adap);
+free_irq:
+	irq_free_desc(gt911_sim.irq);
+	return ret;
+}
+
+static void __exit gt911_sim_exit(void)
+{
+	unsigned long flags;
+
+	misc_deregister(&gt911_sim.misc);
+
+	spin_lock_irqsave(&gt911_sim.lock, flags);
+	gt911_sim.stopping = true;
+	spin_unlock_irqrestore(&gt911_sim.lock, flags);
+	hrtimer_cancel(&gt911_sim.timer);
+
+	i2c_unregister_device(gt911_sim.client);
+	i2c_del_adapter(&gt911_sim.adap);
+	irq_free_desc(gt911_sim.irq);
+
+	printk("gt911_sim: %u frames, %u stalls, %u config writes\r\n",
+	       gt911_sim.seq, gt911_sim.stalls, gt911_sim.config_writes);
+}
+
+module_init(gt911_sim_init);
+module_exit(gt911_sim_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alvin <yuanye0814@gmail.com>");
+MODULE_DESCRIPTION("Simulated GT911 touch controller");
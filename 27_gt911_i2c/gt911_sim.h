@@ -0,0 +1,40 @@
+/*
+ * Interface of the simulated GT911 (gt911_sim.ko) shared with
+ * gt911_replay_app. Everything goes through /dev/gt911_sim:
+ *
+ *   write() - queue struct gt911_sim_frame records; each one is latched
+ *             into the 0x814E coordinate buffer delay_us after the
+ *             previous one and signalled on the emulated INT line
+ *   read()  - struct gt911_sim_stamp for every latched frame, oldest
+ *             first, so INT-to-evdev latency can be measured
+ */
+#ifndef _GT911_SIM_H
+#define _GT911_SIM_H
+
+#include <linux/types.h>
+
+#define GT911_SIM_DEV_NAME	"gt911_sim"
+#define GT911_SIM_MAX_POINTS	10
+
+struct gt911_sim_point {
+	__u8 id;		/* track id, 0-15 */
+	__u8 reserved;
+	__u16 x;
+	__u16 y;
+	__u16 w;
+};
+
+struct gt911_sim_frame {
+	__u32 delay_us;		/* from the previous latch to this one */
+	__u8 touch_num;		/* 0 reports all fingers up */
+	__u8 reserved[3];
+	struct gt911_sim_point pts[GT911_SIM_MAX_POINTS];
+};
+
+struct gt911_sim_stamp {
+	__u32 seq;		/* frame number since the module loaded */
+	__u32 stalls;		/* times the host had not acked yet */
+	__u64 latch_ns;		/* CLOCK_MONOTONIC at INT assertion */
+};
+
+#endif /* _GT911_SIM_H */
@@ -0,0 +1,94 @@
+/*
+ * Tracepoints for the gt911 touch pipeline.
+ *
+ * Enable with:
+ *   echo 1 > /sys/kernel/debug/tracing/events/gt911/enable
+ * or record with "perf record -e 'gt911:*'".
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM gt911
+
+#if !defined(_GT911_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _GT911_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* INT edge seen by the hard IRQ handler */
+TRACE_EVENT(gt911_irq,
+	TP_PROTO(int irq),
+	TP_ARGS(irq),
+	TP_STRUCT__entry(
+		__field(int, irq)
+	),
+	TP_fast_assign(
+		__entry->irq = irq;
+	),
+	TP_printk("irq=%d", __entry->irq)
+);
+
+TRACE_EVENT(gt911_read_start,
+	TP_PROTO(u16 reg, int len),
+	TP_ARGS(reg, len),
+	TP_STRUCT__entry(
+		__field(u16, reg)
+		__field(int, len)
+	),
+	TP_fast_assign(
+		__entry->reg = reg;
+		__entry->len = len;
+	),
+	TP_printk("reg=0x%04x len=%d", __entry->reg, __entry->len)
+);
+
+TRACE_EVENT(gt911_read_end,
+	TP_PROTO(u16 reg, int len, int ret),
+	TP_ARGS(reg, len, ret),
+	TP_STRUCT__entry(
+		__field(u16, reg)
+		__field(int, len)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->reg = reg;
+		__entry->len = len;
+		__entry->ret = ret;
+	),
+	TP_printk("reg=0x%04x len=%d ret=%d",
+		  __entry->reg, __entry->len, __entry->ret)
+);
+
+/* input_sync() done for one frame */
+TRACE_EVENT(gt911_report,
+	TP_PROTO(int touch_num),
+	TP_ARGS(touch_num),
+	TP_STRUCT__entry(
+		__field(int, touch_num)
+	),
+	TP_fast_assign(
+		__entry->touch_num = touch_num;
+	),
+	TP_printk("touch_num=%d", __entry->touch_num)
+);
+
+/* buffer status register cleared, controller may latch the next frame */
+TRACE_EVENT(gt911_clear,
+	TP_PROTO(int ret),
+	TP_ARGS(ret),
+	TP_STRUCT__entry(
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		__entry->ret = ret;
+	),
+	TP_printk("ret=%d", __entry->ret)
+);
+
+#endif /* _GT911_TRACE_H */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE gt911_trace
+#include <trace/define_trace.h>
@@ -0,0 +1,546 @@
+/*
+ * Simulated GPIO controller
+ *
+ * A gpio_chip with its own irq domain, bound from DT like a real bank
+ * (compatible "alpha,gpio-sim", see imx6ull-alpha-emmc-sim.dts).
+ * Pointing /key, /gpio_led and /beep at it lets the key, LED and beep
+ * modules of this repo load unmodified without the board's buttons and
+ * LEDs attached.
+ *
+ * Input levels are driven from /dev/gpio_sim: edge records written there
+ * are applied one at a time by an hrtimer, each delay_ns after the
+ * previous one, and raise the line's irq when the requested trigger type
+ * matches. Edges arriving while the irq is masked are latched and
+ * replayed on unmask, like a controller's status register. Every applied
+ * edge and every output change made by a driver is logged with a
+ * timestamp that can be read back from /dev/gpio_sim.
+ *
+ * See gpio_sim.h for the record formats and gpio_sim_test_app.c for the
+ * userspace side.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/version.h>
+#include <linux/platform_device.h>
+#include <linux/of.h>
+#include <linux/gpio.h>
+#include <linux/irq.h>
+#include <linux/irqdomain.h>
+#include <linux/interrupt.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/kfifo.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/bitops.h>
+
+#include "gpio_sim.h"
+
+#define SIM_DEFAULT_LINES	8
+#define SIM_FIFO_EDGES		4096
+#define SIM_FIFO_STAMPS		8192
+
+struct gpio_sim_dev {
+	struct device *dev;
+	struct gpio_chip chip;
+	struct irq_domain *domain;
+	struct miscdevice misc;
+	unsigned int ngpio;
+
+	spinlock_t lock;			/* levels, fifos, running */
+	DECLARE_BITMAP(in_level, GPIO_SIM_MAX_LINES);
+	DECLARE_BITMAP(out_level, GPIO_SIM_MAX_LINES);
+	DECLARE_BITMAP(dir_out, GPIO_SIM_MAX_LINES);
+	DECLARE_BITMAP(masked, GPIO_SIM_MAX_LINES);	/* irq chip state */
+	DECLARE_BITMAP(latched, GPIO_SIM_MAX_LINES);	/* edge while masked */
+	unsigned int trigger[GPIO_SIM_MAX_LINES];
+	bool running;				/* edge timer armed */
+	bool stopping;
+
+	struct mutex write_lock;		/* single edges producer */
+	DECLARE_KFIFO(edges, struct gpio_sim_edge, SIM_FIFO_EDGES);
+	wait_queue_head_t edge_wait;
+
+	DECLARE_KFIFO(stamps, struct gpio_sim_stamp, SIM_FIFO_STAMPS);
+	wait_queue_head_t stamp_wait;
+
+	struct hrtimer timer;
+	struct tasklet_struct replay;
+	u32 seq;
+	u32 edges_applied;
+	u32 irqs;
+	u32 stamps_lost;			/* log full, reader too slow */
+};
+
+static struct gpio_sim_dev gpio_sim;
+
+/* Log one line change, caller holds the lock */
+static void sim_stamp(unsigned int line, int value, u8 flags)
+{
+	struct gpio_sim_stamp st;
+
+	st.seq = gpio_sim.seq++;
+	st.line = line;
+	st.value = value;
+	st.flags = flags;
+	st.time_ns = ktime_get_ns();
+	if (!kfifo_put(&gpio_sim.stamps, st))
+		gpio_sim.stamps_lost++;
+}
+
+static int sim_gpio_get(struct gpio_chip *chip, unsigned offset)
+{
+	if (test_bit(offset, gpio_sim.dir_out))
+		return test_bit(offset, gpio_sim.out_level);
+
+	return test_bit(offset, gpio_sim.in_level);
+}
+
+/* Latch an output level; only a real change on an output is logged */
+static void sim_set_locked(unsigned offset, int value)
+{
+	bool changed = !!test_bit(offset, gpio_sim.out_level) != !!value;
+
+	if (value)
+		__set_bit(offset, gpio_sim.out_level);
+	else
+		__clear_bit(offset, gpio_sim.out_level);
+
+	if (changed && test_bit(offset, gpio_sim.dir_out))
+		sim_stamp(offset, !!value, GPIO_SIM_STAMP_OUTPUT);
+}
+
+static void sim_gpio_set(struct gpio_chip *chip, unsigned offset, int value)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&gpio_sim.lock, flags);
+	sim_set_locked(offset, value);
+	spin_unlock_irqrestore(&gpio_sim.lock, flags);
+
+	wake_up_interruptible(&gpio_sim.stamp_wait);
+}
+
+static int sim_gpio_direction_input(struct gpio_chip *chip, unsigned offset)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&gpio_sim.lock, flags);
+	__clear_bit(offset, gpio_sim.dir_out);
+	spin_unlock_irqrestore(&gpio_sim.lock, flags);
+
+	return 0;
+}
+
+static int sim_gpio_direction_output(struct gpio_chip *chip, unsigned offset,
+				     int value)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&gpio_sim.lock, flags);
+	/* switching to output drives the line, log it even if unchanged */
+	if (!test_bit(offset, gpio_sim.dir_out)) {
+		__set_bit(offset, gpio_sim.dir_out);
+		if (value)
+			__set_bit(offset, gpio_sim.out_level);
+		else
+			__clear_bit(offset, gpio_sim.out_level);
+		sim_stamp(offset, !!value, GPIO_SIM_STAMP_OUTPUT);
+	} else {
+		sim_set_locked(offset, value);
+	}
+	spin_unlock_irqrestore(&gpio_sim.lock, flags);
+
+	wake_up_interruptible(&gpio_sim.stamp_wait);
+	return 0;
+}
+
+static int sim_gpio_to_irq(struct gpio_chip *chip, unsigned offset)
+{
+	return irq_create_mapping(gpio_sim.domain, offset);
+}
+
+/*
+ * irq chip callbacks run under the descriptor lock, the per-line state
+ * they touch is kept in atomic bitops so they never take gpio_sim.lock.
+ */
+static void sim_irq_mask(struct irq_data *d)
+{
+	set_bit(irqd_to_hwirq(d), gpio_sim.masked);
+}
+
+static void sim_irq_unmask(struct irq_data *d)
+{
+	irq_hw_number_t line = irqd_to_hwirq(d);
+
+	clear_bit(line, gpio_sim.masked);
+	if (test_bit(line, gpio_sim.latched))
+		tasklet_schedule(&gpio_sim.replay);
+}
+
+static int sim_irq_set_type(struct irq_data *d, unsigned int type)
+{
+	irq_hw_number_t line = irqd_to_hwirq(d);
+
+	gpio_sim.trigger[line] = type & IRQ_TYPE_SENSE_MASK;
+	/* a new trigger starts from a clean status */
+	clear_bit(line, gpio_sim.latched);
+
+	return 0;
+}
+
+static struct irq_chip sim_irq_chip = {
+	.name = "gpio-sim",
+	.irq_mask = sim_irq_mask,
+	.irq_unmask = sim_irq_unmask,
+	.irq_set_type = sim_irq_set_type,
+};
+
+static int sim_irq_map(struct irq_domain *d, unsigned int virq,
+		       irq_hw_number_t hw)
+{
+	irq_set_chip_data(virq, &gpio_sim);
+	irq_set_chip_and_handler(virq, &sim_irq_chip, handle_level_irq);
+
+	return 0;
+}
+
+static const struct irq_domain_ops sim_domain_ops = {
+	.map = sim_irq_map,
+	.xlate = irq_domain_xlate_twocell,
+};
+
+/* Deliver edges latched while their line was masked */
+static void sim_replay_fn(unsigned long data)
+{
+	unsigned long flags;
+	unsigned int line;
+
+	for_each_set_bit(line, gpio_sim.latched, gpio_sim.ngpio) {
+		if (test_bit(line, gpio_sim.masked) ||
+		    !test_and_clear_bit(line, gpio_sim.latched))
+			continue;
+
+		local_irq_save(flags);
+		generic_handle_irq(irq_find_mapping(gpio_sim.domain, line));
+		local_irq_restore(flags);
+	}
+}
+
+static bool sim_trigger_matches(unsigned int type, int old, int new)
+{
+	if (old == new)
+		return false;
+	if (new)
+		return type & (IRQ_TYPE_EDGE_RISING | IRQ_TYPE_LEVEL_HIGH);
+
+	return type & (IRQ_TYPE_EDGE_FALLING | IRQ_TYPE_LEVEL_LOW);
+}
+
+/*
+ * Drive one input line, caller holds the lock. Returns the irq to raise
+ * once the lock is dropped, 0 for none. Edges for lines past ngpios are
+ * dropped.
+ */
+static unsigned int sim_apply(const struct gpio_sim_edge *e)
+{
+	unsigned int line = e->line;
+	unsigned int virq;
+	u8 flags = GPIO_SIM_STAMP_INPUT;
+	int old, new = !!e->value;
+
+	if (line >= gpio_sim.ngpio)
+		return 0;
+
+	old = test_bit(line, gpio_sim.in_level);
+	if (new)
+		set_bit(line, gpio_sim.in_level);
+	else
+		clear_bit(line, gpio_sim.in_level);
+	gpio_sim.edges_applied++;
+
+	virq = irq_find_mapping(gpio_sim.domain, line);
+	if (!virq || !sim_trigger_matches(gpio_sim.trigger[line], old, new)) {
+		virq = 0;
+	} else if (test_bit(line, gpio_sim.masked)) {
+		set_bit(line, gpio_sim.latched);
+		flags |= GPIO_SIM_STAMP_LATCHED;
+		virq = 0;
+	} else {
+		flags |= GPIO_SIM_STAMP_IRQ;
+		gpio_sim.irqs++;
+	}
+
+	sim_stamp(line, new, flags);
+	return virq;
+}
+
+static enum hrtimer_restart sim_timer_fn(struct hrtimer *timer)
+{
+	struct gpio_sim_edge e;
+	unsigned int virq;
+	u32 next_ns;
+	bool more;
+
+	/* zero-delay edges are applied back to back in one expiry */
+	do {
+		spin_lock(&gpio_sim.lock);
+		if (gpio_sim.stopping || !kfifo_get(&gpio_sim.edges, &e)) {
+			gpio_sim.running = false;
+			spin_unlock(&gpio_sim.lock);
+			return HRTIMER_NORESTART;
+		}
+
+		virq = sim_apply(&e);
+
+		more = kfifo_peek(&gpio_sim.edges, &e);
+		next_ns = more ? e.delay_ns : 0;
+		if (!more)
+			gpio_sim.running = false;
+		spin_unlock(&gpio_sim.lock);
+
+		if (virq)
+			generic_handle_irq(virq);
+	} while (more && !next_ns);
+
+	wake_up_interruptible(&gpio_sim.stamp_wait);
+	wake_up_interruptible(&gpio_sim.edge_wait);
+
+	if (!more)
+		return HRTIMER_NORESTART;
+
+	/*
+	 * Step from the previous expiry, not from now, so a late callback
+	 * does not stretch the whole sequence and the edge rate holds.
+	 */
+	hrtimer_set_expires(timer, ktime_add_ns(hrtimer_get_expires(timer),
+						next_ns));
+	return HRTIMER_RESTART;
+}
+
+/* Arm the edge timer for the head record if it is not running yet */
+static void sim_kick(void)
+{
+	struct gpio_sim_edge e;
+	unsigned long flags;
+
+	spin_lock_irqsave(&gpio_sim.lock, flags);
+	if (!gpio_sim.running && !gpio_sim.stopping &&
+	    kfifo_peek(&gpio_sim.edges, &e)) {
+		gpio_sim.running = true;
+		hrtimer_start(&gpio_sim.timer, ns_to_ktime(e.delay_ns),
+			      HRTIMER_MODE_REL);
+	}
+	spin_unlock_irqrestore(&gpio_sim.lock, flags);
+}
+
+static ssize_t sim_write(struct file *filp, const char __user *buf,
+			 size_t cnt, loff_t *off)
+{
+	unsigned int copied;
+	size_t len = rounddown(cnt, sizeof(struct gpio_sim_edge));
+	int ret;
+
+	if (!len)
+		return -EINVAL;
+
+	if (mutex_lock_interruptible(&gpio_sim.write_lock))
+		return -ERESTARTSYS;
+
+	if (kfifo_is_full(&gpio_sim.edges)) {
+		mutex_unlock(&gpio_sim.write_lock);
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(gpio_sim.edge_wait,
+					       !kfifo_is_full(&gpio_sim.edges));
+		if (ret)
+			return ret;
+		if (mutex_lock_interruptible(&gpio_sim.write_lock))
+			return -ERESTARTSYS;
+	}
+
+	ret = kfifo_from_user(&gpio_sim.edges, buf, len, &copied);
+	mutex_unlock(&gpio_sim.write_lock);
+	if (ret)
+		return ret;
+
+	sim_kick();
+
+	return copied;
+}
+
+static ssize_t sim_read(struct file *filp, char __user *buf,
+			size_t cnt, loff_t *off)
+{
+	unsigned int copied;
+	size_t len = rounddown(cnt, sizeof(struct gpio_sim_stamp));
+	int ret;
+
+	if (!len)
+		return -EINVAL;
+
+	if (kfifo_is_empty(&gpio_sim.stamps)) {
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(gpio_sim.stamp_wait,
+					!kfifo_is_empty(&gpio_sim.stamps));
+		if (ret)
+			return ret;
+	}
+
+	/* single reader: kfifo_to_user runs against the timer as producer */
+	ret = kfifo_to_user(&gpio_sim.stamps, buf, len, &copied);
+
+	return ret ? ret : copied;
+}
+
+static unsigned int sim_poll(struct file *filp, struct poll_table_struct *wait)
+{
+	unsigned int mask = 0;
+
+	poll_wait(filp, &gpio_sim.stamp_wait, wait);
+	poll_wait(filp, &gpio_sim.edge_wait, wait);
+
+	if (!kfifo_is_empty(&gpio_sim.stamps))
+		mask |= POLLIN | POLLRDNORM;
+	if (!kfifo_is_full(&gpio_sim.edges))
+		mask |= POLLOUT | POLLWRNORM;
+
+	return mask;
+}
+
+static const struct file_operations sim_fops = {
+	.owner = THIS_MODULE,
+	.read = sim_read,
+	.write = sim_write,
+	.poll = sim_poll,
+	.llseek = noop_llseek,
+};
+
+static int gpio_sim_probe(struct platform_device *pdev)
+{
+	struct device_node *np = pdev->dev.of_node;
+	u32 ngpio = SIM_DEFAULT_LINES;
+	int ret;
+
+	/* one /dev/gpio_sim, so one bank */
+	if (gpio_sim.dev)
+		return -EBUSY;
+
+	of_property_read_u32(np, "ngpios", &ngpio);
+	if (!ngpio || ngpio > GPIO_SIM_MAX_LINES) {
+		dev_err(&pdev->dev, "ngpios must be 1..%d\n",
+			GPIO_SIM_MAX_LINES);
+		return -EINVAL;
+	}
+
+	memset(&gpio_sim, 0, sizeof(gpio_sim));
+	gpio_sim.ngpio = ngpio;
+	spin_lock_init(&gpio_sim.lock);
+	mutex_init(&gpio_sim.write_lock);
+	INIT_KFIFO(gpio_sim.edges);
+	INIT_KFIFO(gpio_sim.stamps);
+	init_waitqueue_head(&gpio_sim.edge_wait);
+	init_waitqueue_head(&gpio_sim.stamp_wait);
+	hrtimer_init(&gpio_sim.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	gpio_sim.timer.function = sim_timer_fn;
+	tasklet_init(&gpio_sim.replay, sim_replay_fn, 0);
+	/* irqs start masked until a driver requests them */
+	bitmap_fill(gpio_sim.masked, GPIO_SIM_MAX_LINES);
+	/* inputs idle high, like keys on pull-ups */
+	bitmap_fill(gpio_sim.in_level, GPIO_SIM_MAX_LINES);
+
+	gpio_sim.domain = irq_domain_add_linear(np, ngpio, &sim_domain_ops,
+						&gpio_sim);
+	if (!gpio_sim.domain)
+		return -ENOMEM;
+
+	gpio_sim.chip.label = dev_name(&pdev->dev);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0)
+	gpio_sim.chip.parent = &pdev->dev;
+#else
+	gpio_sim.chip.dev = &pdev->dev;
+#endif
+	gpio_sim.chip.owner = THIS_MODULE;
+	gpio_sim.chip.of_node = np;
+	gpio_sim.chip.base = -1;
+	gpio_sim.chip.ngpio = ngpio;
+	gpio_sim.chip.can_sleep = false;
+	gpio_sim.chip.get = sim_gpio_get;
+	gpio_sim.chip.set = sim_gpio_set;
+	gpio_sim.chip.direction_input = sim_gpio_direction_input;
+	gpio_sim.chip.direction_output = sim_gpio_direction_output;
+	gpio_sim.chip.to_irq = sim_gpio_to_irq;
+
+	ret = gpiochip_add(&gpio_sim.chip);
+	if (ret)
+		goto remove_domain;
+
+	gpio_sim.misc.minor = MISC_DYNAMIC_MINOR;
+	gpio_sim.misc.name = GPIO_SIM_DEV_NAME;
+	gpio_sim.misc.fops = &sim_fops;
+	ret = misc_register(&gpio_sim.misc);
+	if (ret)
+		goto remove_chip;
+
+	gpio_sim.dev = &pdev->dev;
+	dev_info(&pdev->dev, "gpio %d-%d\n", gpio_sim.chip.base,
+		 gpio_sim.chip.base + ngpio - 1);
+	return 0;
+
+remove_chip:
+	gpiochip_remove(&gpio_sim.chip);
+remove_domain:
+	irq_domain_remove(gpio_sim.domain);
+	return ret;
+}
+
+static int gpio_sim_remove(struct platform_device *pdev)
+{
+	unsigned long flags;
+	unsigned int line;
+
+	misc_deregister(&gpio_sim.misc);
+
+	spin_lock_irqsave(&gpio_sim.lock, flags);
+	gpio_sim.stopping = true;
+	spin_unlock_irqrestore(&gpio_sim.lock, flags);
+	hrtimer_cancel(&gpio_sim.timer);
+	tasklet_kill(&gpio_sim.replay);
+
+	gpiochip_remove(&gpio_sim.chip);
+	for (line = 0; line < gpio_sim.ngpio; line++)
+		irq_dispose_mapping(irq_find_mapping(gpio_sim.domain, line));
+	irq_domain_remove(gpio_sim.domain);
+
+	dev_info(&pdev->dev, "%u edges, %u irqs, %u stamps lost\n",
+		 gpio_sim.edges_applied, gpio_sim.irqs, gpio_sim.stamps_lost);
+	gpio_sim.dev = NULL;
+	return 0;
+}
+
+static const struct of_device_id gpio_sim_of_match[] = {
+	{ .compatible = "alpha,gpio-sim" },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, gpio_sim_of_match);
+
+static struct platform_driver gpio_sim_driver = {
+	.driver = {
+		.name = "gpio-sim",
+		.of_match_table = gpio_sim_of_match,
+	},
+	.probe = gpio_sim_probe,
+	.remove = gpio_sim_remove,
+};
+
+module_platform_driver(gpio_sim_driver);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alvin <yuanye0814@gmail.com>");
+MODULE_DESCRIPTION("Simulated GPIO controller");
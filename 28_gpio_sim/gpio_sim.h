@@ -0,0 +1,39 @@
+/*
+ * Interface of the simulated GPIO controller (gpio_sim.ko) shared with
+ * gpio_sim_test_app. Everything goes through /dev/gpio_sim:
+ *
+ *   write() - queue struct gpio_sim_edge records; each one drives an
+ *             input line to value delay_ns after the previous one and
+ *             raises the line's irq if its trigger type matches
+ *   read()  - struct gpio_sim_stamp for every applied edge and every
+ *             output change made by a driver, oldest first
+ */
+#ifndef _GPIO_SIM_H
+#define _GPIO_SIM_H
+
+#include <linux/types.h>
+
+#define GPIO_SIM_DEV_NAME	"gpio_sim"
+#define GPIO_SIM_MAX_LINES	32
+
+struct gpio_sim_edge {
+	__u32 delay_ns;		/* from the previous edge to this one */
+	__u16 line;		/* offset on the simulated chip */
+	__u8 value;		/* physical level, 0 or 1 */
+	__u8 reserved;
+};
+
+#define GPIO_SIM_STAMP_INPUT	0x01	/* edge applied from the queue */
+#define GPIO_SIM_STAMP_OUTPUT	0x02	/* driver changed an output */
+#define GPIO_SIM_STAMP_IRQ	0x04	/* input edge raised the irq */
+#define GPIO_SIM_STAMP_LATCHED	0x08	/* input edge latched while masked */
+
+struct gpio_sim_stamp {
+	__u32 seq;		/* stamp number since the module loaded */
+	__u16 line;
+	__u8 value;
+	__u8 flags;		/* GPIO_SIM_STAMP_* */
+	__u64 time_ns;		/* CLOCK_MONOTONIC */
+};
+
+#endif /* _GPIO_SIM_H */
@@ -0,0 +1,410 @@
+/*
+ * Stress and conformance tests for the key, LED and beep modules on top
+ * of gpio_sim.ko (boot imx6ull-alpha-emmc-sim.dtb, insmod gpio_sim.ko,
+ * then the module under test).
+ *
+ *   gpio_sim_test_app key <dev> [-f pair|sample|event|input] [-l line]
+ *                     [-n presses] [-b bounces] [-r edges_per_s] [-s settle_ms]
+ *       Each press and each release is a burst of 2 * bounces + 1 edges
+ *       at edges_per_s that ends on the new level, followed by settle_ms
+ *       of quiet. The module must report exactly one event per burst, in
+ *       order, press first, never before the burst's last edge.
+ *
+ *   gpio_sim_test_app out <dev> [-l line] [-n toggles] [-H]
+ *       Writes "on"/"off" to an LED or beep node and checks that every
+ *       write reaches the line with the right level (active low unless
+ *       -H), and nothing else does.
+ *
+ * Read formats of the key modules:
+ *   pair    int id, int value (0 pressed)          15_key_irq .. 17_key_irq_work
+ *   sample  struct key_sample                       15_key_irq .. 17_key_irq_work
+ *   event   struct key_event                        18_key_wait .. 20_key_signal
+ *   input   struct input_event, EV_KEY only         24_input
+ *
+ * Exit status is 0 when every check passes.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <stdint.h>
+#include <linux/input.h>
+
+#include "gpio_sim.h"
+
+#define SIM_NODE        "/dev/" GPIO_SIM_DEV_NAME
+#define MAX_EVENTS      65536
+
+/* same layouts as 15_key_irq/key_sample.h and 18_key_wait/key_event.h */
+struct key_sample_rec {
+    int32_t id;
+    int32_t value;
+    uint64_t irq_ns;
+    uint64_t report_ns;
+};
+
+struct key_event_rec {
+    uint32_t id;
+    int32_t value;
+    uint64_t time_ns;
+};
+
+enum key_format { FMT_PAIR, FMT_SAMPLE, FMT_EVENT, FMT_INPUT };
+
+struct key_ev {
+    int id;
+    int pressed;
+    uint64_t time_ns;       /* 0 when the format has no timestamp */
+};
+
+static struct key_ev events[MAX_EVENTS];
+static int nevents;
+
+static uint64_t burst_end_ns[MAX_EVENTS];  /* last input edge of each burst */
+static int nbursts;
+
+static int failures;
+
+#define CHECK(cond, ...)                        \
+    do {                                        \
+        if (!(cond)) {                          \
+            printf("FAIL: " __VA_ARGS__);       \
+            failures++;                         \
+        }                                       \
+    } while (0)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void add_event(int id, int pressed, uint64_t t)
+{
+    if (nevents < MAX_EVENTS) {
+        events[nevents].id = id;
+        events[nevents].pressed = pressed;
+        events[nevents].time_ns = t;
+    }
+    nevents++;
+}
+
+/* Read whatever the key module has queued, normalized to key_ev */
+static void read_key_events(int fd, enum key_format fmt)
+{
+    char buf[4096];
+    ssize_t n;
+    size_t rec, i;
+
+    switch (fmt) {
+    case FMT_PAIR:   rec = 2 * sizeof(int32_t); break;
+    case FMT_SAMPLE: rec = sizeof(struct key_sample_rec); break;
+    case FMT_EVENT:  rec = sizeof(struct key_event_rec); break;
+    default:         rec = sizeof(struct input_event); break;
+    }
+
+    /* pair and sample modules hand out one record per read */
+    while ((n = read(fd, buf, fmt <= FMT_SAMPLE ? rec : sizeof(buf))) > 0) {
+        for (i = 0; i + rec <= (size_t)n; i += rec) {
+            void *p = buf + i;
+
+            if (fmt == FMT_PAIR) {
+                int32_t *v = p;
+                add_event(v[0], v[1] == 0, 0);
+            } else if (fmt == FMT_SAMPLE) {
+                struct key_sample_rec *s = p;
+                add_event(s->id, s->value == 0, s->report_ns);
+            } else if (fmt == FMT_EVENT) {
+                struct key_event_rec *e = p;
+                add_event(e->id, e->value == 0, e->time_ns);
+            } else {
+                struct input_event *ie = p;
+                /* evdev timestamps are realtime, skip the ordering check */
+                if (ie->type == EV_KEY && ie->value != 2)
+                    add_event(ie->code, ie->value == 1, 0);
+            }
+        }
+    }
+}
+
+struct sim_totals {
+    int inputs;
+    int irqs;
+    int latched;
+    int outputs;
+    uint64_t first_ns;
+    uint64_t last_ns;
+    int last_out_value;
+};
+
+/* Drain the simulator log, tallying stamps of one line (-1: discard all) */
+static void read_sim_stamps(int fd, int line, int edges_per_burst,
+                            struct sim_totals *t)
+{
+    struct gpio_sim_stamp st[256];
+    ssize_t n;
+    int i;
+
+    while ((n = read(fd, st, sizeof(st))) > 0) {
+        for (i = 0; i < n / (int)sizeof(st[0]); i++) {
+            if (st[i].line != line)
+                continue;
+            if (st[i].flags & GPIO_SIM_STAMP_OUTPUT) {
+                t->outputs++;
+                t->last_out_value = st[i].value;
+                continue;
+            }
+            if (!t->inputs)
+                t->first_ns = st[i].time_ns;
+            t->last_ns = st[i].time_ns;
+            t->inputs++;
+            if (st[i].flags & GPIO_SIM_STAMP_IRQ)
+                t->irqs++;
+            if (st[i].flags & GPIO_SIM_STAMP_LATCHED)
+                t->latched++;
+            if (edges_per_burst && t->inputs % edges_per_burst == 0 &&
+                nbursts < MAX_EVENTS)
+                burst_end_ns[nbursts++] = st[i].time_ns;
+        }
+    }
+}
+
+static int test_key(const char *dev, enum key_format fmt, int line,
+                    int presses, int bounces, int rate, int settle_ms)
+{
+    int per_burst = 2 * bounces + 1;
+    int total = 2 * presses * per_burst;
+    struct gpio_sim_edge *edges;
+    struct sim_totals t;
+    struct pollfd pfd[2];
+    uint64_t idle_since = 0;
+    uint64_t progress_ns;
+    int last_inputs = 0;
+    int simfd, keyfd;
+    int written = 0;
+    int i, b, level;
+
+    simfd = open(SIM_NODE, O_RDWR | O_NONBLOCK);
+    keyfd = open(dev, O_RDONLY | O_NONBLOCK);
+    if (simfd < 0 || keyfd < 0) {
+        perror(simfd < 0 ? SIM_NODE : dev);
+        return 1;
+    }
+
+    /* burst k ends on pressed (0) for even k, released (1) for odd k */
+    edges = calloc(total, sizeof(*edges));
+    if (!edges)
+        return 1;
+    for (i = 0; i < 2 * presses; i++) {
+        for (b = 0; b < per_burst; b++) {
+            struct gpio_sim_edge *e = &edges[i * per_burst + b];
+
+            level = (i & 1) ? !(b & 1) : (b & 1);
+            e->line = line;
+            e->value = level;
+            e->delay_ns = b ? 1000000000u / rate : settle_ms * 1000000u;
+        }
+    }
+
+    /* start from a quiet line and empty queues */
+    memset(&t, 0, sizeof(t));
+    read_sim_stamps(simfd, -1, 0, &t);
+    read_key_events(keyfd, fmt);
+    nevents = 0;
+
+    printf("%s: %d presses, %d edges per burst at %d edges/s, %d ms settle\n",
+           dev, presses, per_burst, rate, settle_ms);
+
+    progress_ns = now_ns();
+    while (1) {
+        pfd[0].fd = simfd;
+        pfd[0].events = POLLIN | (written < total ? POLLOUT : 0);
+        pfd[1].fd = keyfd;
+        pfd[1].events = POLLIN;
+        poll(pfd, 2, settle_ms);
+
+        if (written < total && (pfd[0].revents & POLLOUT)) {
+            ssize_t n = write(simfd, &edges[written],
+                              (total - written) * sizeof(*edges));
+            if (n > 0)
+                written += n / sizeof(*edges);
+        }
+        read_sim_stamps(simfd, line, per_burst, &t);
+        read_key_events(keyfd, fmt);
+
+        if (t.inputs != last_inputs) {
+            last_inputs = t.inputs;
+            progress_ns = now_ns();
+        } else if (t.inputs < total && now_ns() - progress_ns > 2000000000ull) {
+            printf("  simulator stalled\n");
+            break;
+        }
+
+        /*
+         * Once every edge is applied, wait for the module to go quiet:
+         * a short tail to catch extra events, longer if some are missing.
+         */
+        if (t.inputs >= total) {
+            int tail = nevents >= 2 * presses ? 3 : 10;
+
+            if (!idle_since)
+                idle_since = now_ns();
+            if (now_ns() - idle_since >= (uint64_t)tail * settle_ms * 1000000)
+                break;
+        }
+    }
+    free(edges);
+
+    printf("  %d edges applied, %d irqs raised, %d latched while masked\n",
+           t.inputs, t.irqs, t.latched);
+    if (t.inputs > 1)
+        printf("  %.0f edges/s over the run\n",
+               (t.inputs - 1) * 1e9 / (t.last_ns - t.first_ns));
+
+    CHECK(t.inputs == total, "%d of %d edges applied\n", t.inputs, total);
+    CHECK(nevents == 2 * presses, "%d events for %d bursts\n",
+          nevents, 2 * presses);
+
+    for (i = 0; i < nevents && i < MAX_EVENTS; i++) {
+        CHECK(events[i].pressed == !(i & 1), "event %d is a %s\n", i,
+              events[i].pressed ? "press" : "release");
+        CHECK(events[i].id == events[0].id, "event %d from key %d\n",
+              i, events[i].id);
+        if (!events[i].time_ns)
+            continue;
+        CHECK(!i || events[i].time_ns >= events[i - 1].time_ns,
+              "event %d goes back in time\n", i);
+        CHECK(i >= nbursts || events[i].time_ns >= burst_end_ns[i],
+              "event %d reported %.1f us before its burst ended\n", i,
+              (burst_end_ns[i] - events[i].time_ns) / 1000.0);
+    }
+
+    close(keyfd);
+    close(simfd);
+    printf("%s\n", failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
+
+static int test_out(const char *dev, int line, int toggles, int active_high)
+{
+    struct sim_totals t;
+    int simfd, outfd;
+    int i, on;
+
+    simfd = open(SIM_NODE, O_RDONLY | O_NONBLOCK);
+    outfd = open(dev, O_WRONLY);
+    if (simfd < 0 || outfd < 0) {
+        perror(simfd < 0 ? SIM_NODE : dev);
+        return 1;
+    }
+
+    /* known state first, then a clean log */
+    if (write(outfd, "off", 3) < 0)
+        perror("write");
+    usleep(1000);
+    memset(&t, 0, sizeof(t));
+    read_sim_stamps(simfd, line, 0, &t);
+
+    for (i = 0; i < toggles; i++) {
+        int outputs = t.outputs;
+
+        on = !(i & 1);
+        if (write(outfd, on ? "on" : "off", on ? 2 : 3) < 0)
+            perror("write");
+        usleep(1000);
+        read_sim_stamps(simfd, line, 0, &t);
+
+        CHECK(t.outputs == outputs + 1, "write %d (%s) changed line %d %d times\n",
+              i, on ? "on" : "off", line, t.outputs - outputs);
+        CHECK(t.last_out_value == (on == active_high),
+              "write %d (%s) left line %d at %d\n", i, on ? "on" : "off",
+              line, t.last_out_value);
+    }
+
+    close(outfd);
+    close(simfd);
+    printf("%s: %d writes, %d line changes\n%s\n", dev, toggles, t.outputs,
+           failures ? "FAILED" : "PASSED");
+    return failures ? 1 : 0;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s key <dev> [-f pair|sample|event|input] [-l line] [-n presses]\n"
+           "          [-b bounces] [-r edges_per_s] [-s settle_ms]\n"
+           "       %s out <dev> [-l line] [-n toggles] [-H]\n", prog, prog);
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *fmt_names[] = { "pair", "sample", "event", "input" };
+    enum key_format fmt = FMT_PAIR;
+    int line = -1;
+    int count = 100;
+    int bounces = 20;
+    int rate = 10000;
+    int settle_ms = 30;
+    int active_high = 0;
+    int is_key;
+    int opt, i;
+
+    if (argc < 3 || (strcmp(argv[1], "key") && strcmp(argv[1], "out"))) {
+        usage(argv[0]);
+        return 1;
+    }
+    is_key = !strcmp(argv[1], "key");
+    optind = 3;
+
+    while ((opt = getopt(argc, argv, "f:l:n:b:r:s:H")) != -1) {
+        switch (opt) {
+        case 'f':
+            for (i = 0; i < 4 && strcmp(optarg, fmt_names[i]); i++)
+                ;
+            if (i == 4) {
+                usage(argv[0]);
+                return 1;
+            }
+            fmt = i;
+            break;
+        case 'l':
+            line = atoi(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'b':
+            bounces = atoi(optarg);
+            break;
+        case 'r':
+            rate = atoi(optarg);
+            break;
+        case 's':
+            settle_ms = atoi(optarg);
+            break;
+        case 'H':
+            active_high = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (count < 1 || bounces < 0 || rate < 1 || settle_ms < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* default lines from imx6ull-alpha-emmc-sim.dts */
+    if (is_key)
+        return test_key(argv[2], fmt, line < 0 ? 0 : line, count, bounces,
+                        rate, settle_ms);
+
+    return test_out(argv[2], line < 0 ? 4 : line, count, active_high);
+}
@@ -0,0 +1,160 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+
+/*
+ * Syscall throughput of a driver node, to compare a module built with
+ * make DRV_DEBUG=2 (hot-path messages on, rate limited) against the
+ * default DRV_DEBUG=0 (compiled out), or the old always-printk build:
+ *
+ *   ./drv_bench_app /dev/gpio_led -o write -s on -n 20000
+ *   ./drv_bench_app /dev/gpio_led -o read -n 20000
+ *   ./drv_bench_app /dev/timer_led_ioctl -o ioctl -c 0x80047802 -n 20000
+ *   ./drv_bench_app /dev/key_irq -o open -n 5000
+ *
+ *   -o open|read|write|ioctl   operation (default read)
+ *   -n N                       calls (default 10000)
+ *   -s STR                     what write() sends (default "on")
+ *   -c CMD                     ioctl request number, arg 0
+ *
+ * Keys are opened O_NONBLOCK so read() returns instead of waiting for a
+ * press. Run with the console at its usual loglevel, that is where the
+ * printk cost shows.
+ */
+
+enum op { OP_OPEN, OP_READ, OP_WRITE, OP_IOCTL, OP_COUNT };
+static const char *op_names[OP_COUNT] = { "open", "read", "write", "ioctl" };
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path;
+    const char *str = "on";
+    unsigned long req = 0;
+    char buf[64];
+    uint64_t start;
+    uint64_t ns;
+    int op = OP_READ;
+    int n = 10000;
+    int errors = 0;
+    int opt;
+    int fd = -1;
+    int i;
+
+    if(argc < 2 || argv[1][0] == '-')
+    {
+        printf("Usage: %s <device_file> [-o open|read|write|ioctl] [-n calls] [-s string] [-c ioctl_cmd]\n", argv[0]);
+        return -1;
+    }
+    path = argv[1];
+    optind = 2;
+
+    while((opt = getopt(argc, argv, "o:n:s:c:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'o':
+                for(op = 0; op < OP_COUNT; op++)
+                {
+                    if(!strcmp(optarg, op_names[op]))
+                    {
+                        break;
+                    }
+                }
+                if(op == OP_COUNT)
+                {
+                    printf("Unknown operation %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'n':
+                n = atoi(optarg);
+                break;
+            case 's':
+                str = optarg;
+                break;
+            case 'c':
+                req = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                return -1;
+        }
+    }
+    if(n < 1)
+    {
+        n = 1;
+    }
+    if(op == OP_IOCTL && !req)
+    {
+        printf("ioctl needs -c\n");
+        return -1;
+    }
+
+    if(op != OP_OPEN)
+    {
+        fd = open(path, O_RDWR | O_NONBLOCK);
+        if(fd < 0)
+        {
+            printf("Failed to open %s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+
+    start = now_ns();
+    for(i = 0; i < n; i++)
+    {
+        int ret = 0;
+
+        switch(op)
+        {
+            case OP_OPEN:
+                ret = open(path, O_RDWR | O_NONBLOCK);
+                if(ret >= 0)
+                {
+                    close(ret);
+                }
+                break;
+            case OP_READ:
+                ret = read(fd, buf, sizeof(buf));
+                if(ret < 0 && errno == EAGAIN)
+                {
+                    ret = 0;
+                }
+                break;
+            case OP_WRITE:
+                ret = write(fd, str, strlen(str));
+                break;
+            case OP_IOCTL:
+                ret = ioctl(fd, req, 0);
+                break;
+        }
+        if(ret < 0)
+        {
+            errors++;
+        }
+    }
+    ns = now_ns() - start;
+
+    printf("%s %s: %d calls, %d errors, %.3f ms, %.0f ns/call, %.0f calls/s\n", path, op_names[op],
+           n, errors, ns / 1e6, (double)ns / n, n * 1e9 / ns);
+
+    if(fd >= 0)
+    {
+        close(fd);
+    }
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef _DRV_DEBUG_H
+#define _DRV_DEBUG_H
+
+#include <linux/printk.h>
+#include <linux/ratelimit.h>
+
+/*
+ * Logging for the hot paths of the modules in this repo: file operations,
+ * timers, irq handlers and their bottom halves. Every module Makefile adds
+ * this directory to the include path and passes DRV_DEBUG through, so the
+ * build is picked on the make command line:
+ *
+ *   make DRV_DEBUG=0   DRV_DBG() compiles to nothing, the arguments are
+ *                      still type checked (default)
+ *   make DRV_DEBUG=1   pr_debug, rate limited. Silent until enabled with
+ *                      dynamic debug, e.g.
+ *                      echo 'module key_irq +p' > /sys/kernel/debug/dynamic_debug/control
+ *   make DRV_DEBUG=2   printk at the default level, rate limited: the old
+ *                      always-on messages without the console flood
+ *
+ * init, probe and exit keep plain printk.
+ */
+#ifndef DRV_DEBUG
+#define DRV_DEBUG 0
+#endif
+
+#if DRV_DEBUG >= 2
+#define DRV_DBG(fmt, ...)   printk_ratelimited(fmt, ##__VA_ARGS__)
+#elif DRV_DEBUG == 1
+#define DRV_DBG(fmt, ...)   pr_debug_ratelimited(fmt, ##__VA_ARGS__)
+#else
+#define DRV_DBG(fmt, ...)   no_printk(fmt, ##__VA_ARGS__)
+#endif
+
+#endif // _DRV_DEBUG_H
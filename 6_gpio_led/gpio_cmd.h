@@ -0,0 +1,70 @@
+#ifndef _GPIO_CMD_H
+#define _GPIO_CMD_H
+
+#include <linux/types.h>
+
+/*
+ * Binary write() format of the gpio_led, beep and misc_beep modules, next
+ * to their "on"/"off" text commands. A write starting with GPIO_CMD_MAGIC
+ * is one header followed by exactly hdr.count commands, executed in order
+ * without per-command logging:
+ *
+ *   struct gpio_cmd_hdr | struct gpio_cmd[0] | ... | struct gpio_cmd[count - 1]
+ *
+ * The whole batch is checked before the first command runs: a bad header,
+ * length or opcode, or delays adding up to more than GPIO_CMD_MAX_DELAY_US,
+ * fail the write with EINVAL and leave the GPIO untouched. Otherwise the
+ * write returns its full length. A signal stops the batch between
+ * commands: the write then returns the bytes consumed (header plus
+ * executed commands), or EINTR if none ran.
+ * Text commands start with 'o' and can never be mistaken for the magic.
+ */
+#define GPIO_CMD_MAGIC      0xc5
+#define GPIO_CMD_VERSION    1
+#define GPIO_CMD_MAX        4096    // commands per write
+#define GPIO_CMD_MAX_DELAY_US   1000000 // sum of GPIO_CMD_DELAY args per write
+
+struct gpio_cmd_hdr {
+    __u8 magic;         // GPIO_CMD_MAGIC
+    __u8 version;       // GPIO_CMD_VERSION
+    __u16 count;        // commands following the header
+};
+
+enum gpio_cmd_op {
+    GPIO_CMD_OFF = 0,
+    GPIO_CMD_ON,
+    GPIO_CMD_TOGGLE,
+    GPIO_CMD_DELAY,     // arg: microseconds, sleeps
+};
+
+struct gpio_cmd {
+    __u8 op;            // enum gpio_cmd_op
+    __u8 reserved;
+    __u16 arg;
+};
+
+#ifdef __KERNEL__
+#include <linux/errno.h>
+
+// check n commands and add their delays to *delay_us, 0 if all of them may run
+static inline int gpio_cmd_check(const struct gpio_cmd *cmds, int n, u32 *delay_us)
+{
+    int i;
+
+    for(i = 0; i < n; i++) {
+        if(cmds[i].op > GPIO_CMD_DELAY) {
+            return -EINVAL;
+        }
+        if(cmds[i].op == GPIO_CMD_DELAY) {
+            *delay_us += cmds[i].arg;
+            if(*delay_us > GPIO_CMD_MAX_DELAY_US) {
+                return -EINVAL;
+            }
+        }
+    }
+
+    return 0;
+}
+#endif
+
+#endif // _GPIO_CMD_H
@@ -22,6 +22,11 @@
 #include <linux/slab.h> // kmalloc, kfree
 #include <linux/gpio.h>
 #include <linux/of_gpio.h>
+#include <linux/delay.h> // udelay, usleep_range
+#include <linux/sched.h> // signal_pending
+
+#include "gpio_cmd.h"
+#include "drv_debug.h"
 
 
 #define NAME "gpio_led"
@@ -30,6 +35,8 @@
 #define DTS_LED_COUNT   1
 #define DTS_LED_NODE_PATH   "/gpio_led"
 
+#define GPIO_CMD_CHUNK  64  // commands copied from userspace per pass
+
 
 #if 0 // reg addr
 // CCM
@@ -83,14 +90,14 @@ void led_off(void)
 /* The various file operations we support. */
 int led_open (struct inode *inode, struct file *filp)
 {
-    printk(NAME " open\n");
+    DRV_DBG(NAME " open\n");
     filp->private_data = &led;
     return 0;
 }
 
 int led_release (struct inode *inode, struct file *filp)
 {
-    printk(NAME " release\n");
+    DRV_DBG(NAME " release\n");
     filp->private_data = NULL;
     return 0;
 }
@@ -102,17 +109,17 @@ ssize_t led_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
     int copy_len = 0;
     int gpio_val;
     
-    printk(NAME " read\n");
+    DRV_DBG(NAME " read\n");
 
     // read led status - use internal state instead of gpio_get_value for output pins
     gpio_val = gpio_get_value(led.led_gpio);
-    printk(NAME " gpio_get_value: %d, led_state: %d\n", gpio_val, led.led_state);
+    DRV_DBG(NAME " gpio_get_value: %d, led_state: %d\n", gpio_val, led.led_state);
     
     if(led.led_state == 1){
-        printk(NAME " led is ON\n");
+        DRV_DBG(NAME " led is ON\n");
         snprintf(read_buf, sizeof(read_buf), "LED is ON\n");
     } else {
-        printk(NAME " led is OFF\n");
+        DRV_DBG(NAME " led is OFF\n");
         snprintf(read_buf, sizeof(read_buf), "LED is OFF\n");
     }
 
@@ -121,37 +128,132 @@ ssize_t led_read (struct file *filp, char __user *buf, size_t count, loff_t *ppo
 
     ret = copy_to_user(buf, read_buf, copy_len); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_to_user failed, %d bytes not copied\n", ret);
+        DRV_DBG(NAME " copy_to_user failed, %d bytes not copied\n", ret);
         return -EFAULT;
     }
     
-    printk(NAME " read %d bytes successfully\n", copy_len);
+    DRV_DBG(NAME " read %d bytes successfully\n", copy_len);
     return copy_len;  // 返回实际读取的字节数
 }
+
+// binary commands, see gpio_cmd.h; no logging per command
+static ssize_t led_write_cmds(const char __user *buf, size_t count)
+{
+    struct gpio_cmd_hdr hdr;
+    struct gpio_cmd cmds[GPIO_CMD_CHUNK];
+    u32 delay_us = 0;
+    int done, n, i;
+    ssize_t ret;
+
+    if(count < sizeof(hdr)) {
+        return -EINVAL;
+    }
+    if(copy_from_user(&hdr, buf, sizeof(hdr))) {
+        return -EFAULT;
+    }
+    if(hdr.version != GPIO_CMD_VERSION || hdr.count > GPIO_CMD_MAX ||
+       count != sizeof(hdr) + hdr.count * sizeof(struct gpio_cmd)) {
+        return -EINVAL;
+    }
+    buf += sizeof(hdr);
+
+    // check the whole batch first, a bad command must not follow ones that already ran
+    for(done = 0; done < hdr.count; done += n) {
+        n = min_t(int, hdr.count - done, GPIO_CMD_CHUNK);
+        if(copy_from_user(cmds, buf + done * sizeof(struct gpio_cmd), n * sizeof(struct gpio_cmd))) {
+            return -EFAULT;
+        }
+        if(gpio_cmd_check(cmds, n, &delay_us)) {
+            return -EINVAL;
+        }
+    }
+
+    // run it, each chunk is checked again as userspace may rewrite the buffer meanwhile
+    delay_us = 0;
+    for(done = 0; done < hdr.count; done += n) {
+        n = min_t(int, hdr.count - done, GPIO_CMD_CHUNK);
+        if(copy_from_user(cmds, buf + done * sizeof(struct gpio_cmd), n * sizeof(struct gpio_cmd))) {
+            ret = -EFAULT;
+            goto stop;
+        }
+        if(gpio_cmd_check(cmds, n, &delay_us)) {
+            ret = -EINVAL;
+            goto stop;
+        }
+
+        for(i = 0; i < n; i++) {
+            // a batch of delays must not hold the caller beyond a signal
+            if(signal_pending(current)) {
+                done += i;
+                ret = -EINTR;
+                goto stop;
+            }
+
+            switch(cmds[i].op) {
+                case GPIO_CMD_OFF:
+                    led_off();
+                    break;
+                case GPIO_CMD_ON:
+                    led_on();
+                    break;
+                case GPIO_CMD_TOGGLE:
+                    if(led.led_state) {
+                        led_off();
+                    } else {
+                        led_on();
+                    }
+                    break;
+                case GPIO_CMD_DELAY:
+                    if(cmds[i].arg < 10) {
+                        udelay(cmds[i].arg);
+                    } else {
+                        usleep_range(cmds[i].arg, cmds[i].arg + cmds[i].arg / 8);
+                    }
+                    break;
+            }
+        }
+    }
+
+    return count;
+
+stop:
+    // report the commands that ran, the error only when none did
+    if(done == 0) {
+        return ret;
+    }
+    return sizeof(hdr) + done * sizeof(struct gpio_cmd);
+}
+
 ssize_t led_write (struct file *filp, const char __user *buf, size_t count, loff_t *ppos)
 {
     int ret = 0;
-    printk(NAME " write %d\n", count);
+    u8 magic;
+
+    if(count && !get_user(magic, buf) && magic == GPIO_CMD_MAGIC) {
+        return led_write_cmds(buf, count);
+    }
+
+    DRV_DBG(NAME " write %d\n", count);
 
     if(count >= sizeof(write_buf)) count = sizeof(write_buf) - 1;
     
     ret = copy_from_user(write_buf, buf, count); // ret fail bytes
     if(ret != 0) {
-        printk(NAME " copy_from_user failed %d\n", ret);
+        DRV_DBG(NAME " copy_from_user failed %d\n", ret);
         return -EFAULT;
     }
 
     write_buf[count] = '\0'; // null terminate the string
-    printk(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
+    DRV_DBG(NAME " write buf ok, count: %d, string: %s\n", ret, write_buf);
 
     if(strncmp(write_buf, "on", 2) == 0) {
         led_on();
-        printk(NAME " led on\n");
+        DRV_DBG(NAME " led on\n");
     } else if(strncmp(write_buf, "off", 3) == 0) {
         led_off();
-        printk(NAME " led off\n");
+        DRV_DBG(NAME " led off\n");
     } else {
-        printk(NAME " invalid command\n");
+        DRV_DBG(NAME " invalid command\n");
     }
 
     return count;
@@ -3,6 +3,17 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include "gpio_cmd.h"
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
 
 /*
 *
@@ -20,7 +31,7 @@ int main(int argc, char *argv[])
     int cmd;
 
     if(argc < 3) {
-        printf("Usage: %s <device_file> <1-read,2-write> <string to write>\n", argv[0]);
+        printf("Usage: %s <device_file> <1-read,2-write,3-batch> <string to write | toggles>\n", argv[0]);
         return -1;
     }
     filename = argv[1];
@@ -73,6 +84,58 @@ int main(int argc, char *argv[])
             printf("Wrote %d to device\n", ret);
         }
     }
+    else if(cmd == 3) // batch: N toggles in one binary write vs N text writes
+    {
+        struct gpio_cmd_hdr *hdr;
+        struct gpio_cmd *cmds;
+        char *batch;
+        size_t len;
+        double start;
+        int n = argc > 3 ? atoi(argv[3]) : 1000;
+        int ret = 0;
+        int i;
+
+        if(n < 1 || n > GPIO_CMD_MAX)
+        {
+            printf("Toggles must be 1-%d\n", GPIO_CMD_MAX);
+            close(fd);
+            return -1;
+        }
+
+        len = sizeof(*hdr) + n * sizeof(*cmds);
+        batch = calloc(1, len);
+        hdr = (struct gpio_cmd_hdr *)batch;
+        cmds = (struct gpio_cmd *)(batch + sizeof(*hdr));
+        hdr->magic = GPIO_CMD_MAGIC;
+        hdr->version = GPIO_CMD_VERSION;
+        hdr->count = n;
+        for(i = 0; i < n; i++)
+        {
+            cmds[i].op = GPIO_CMD_TOGGLE;
+        }
+
+        start = now_us();
+        for(i = 0; i < n; i++)
+        {
+            ret = write(fd, (i & 1) ? "off" : "on", (i & 1) ? 3 : 2);
+        }
+        printf("text:   %d writes, %.1f us\n", n, now_us() - start);
+
+        start = now_us();
+        ret = write(fd, batch, len);
+        if(ret < 0)
+        {
+            printf("Failed to write batch\n");
+        }
+        else
+        {
+            printf("binary: 1 write of %d commands, %.1f us\n", n, now_us() - start);
+        }
+
+        // leave it off
+        write(fd, "off", 3);
+        free(batch);
+    }
     else
     {
         printf("Invalid command\n");